@@ -1,5 +1,14 @@
 
 #include <adel.h>
 
+#ifndef ADEL_COROUTINES
 AdelRuntime * AdelRuntime::curStack = 0;
 bool AdelRuntime::safeCall = false;
+AdelRuntime * AdelRuntime::first = 0;
+AdelPrioRuntime * AdelPrioRuntime::firstprio = 0;
+void (*AdelRuntime::sleepfn)(uint32_t ms) = 0;
+#endif
+volatile uint16_t AdelEvent::epoch = 0;
+AdelSemaphore * AdelSemaphore::first = 0;
+uint16_t AdelSemaphore::alllisted = 0;
+uint32_t adel_now = 0;
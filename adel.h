@@ -19,6 +19,107 @@
 #define ADEL_V4
 
 #define ADEL_FINALLY 0xFFFF
+#define ADEL_CLEANUP 0xFFFE
+
+/** adel_millis
+ *
+ *  All of Adel's timing goes through this macro, which reads the Arduino
+ *  clock by default. Define it before including adel.h to substitute a
+ *  different time source -- for example, a virtual clock when running
+ *  Adel code off-device against a stand-in Arduino.h, so that tests can
+ *  advance time deterministically.
+ */
+#ifndef adel_millis
+#define adel_millis() millis()
+#endif
+
+#ifndef adel_micros
+#define adel_micros() micros()
+#endif
+
+/** adel_before
+ *
+ *  Is time a before time b? Comparing the signed difference instead of the
+ *  raw values gives the right answer even when the clock wraps around, as
+ *  long as the two times are less than half the range apart. millis()
+ *  wraps after 49.7 days and micros() after 71 minutes, so every time
+ *  comparison in Adel goes through this function.
+ */
+inline bool adel_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+/** adel_now
+ *
+ *  The time at the start of the current pass. Each top-level runtime reads
+ *  the clock once per pass, and all of the constructs use this value, so
+ *  that time is consistent within a pass and we do not pay for a call to
+ *  millis() (which disables interrupts on some boards) in every construct.
+ */
+extern uint32_t adel_now;
+
+/** adel_ramp
+ *
+ *  One step of aramp: if no more than T ms have gone by since start, set
+ *  v to the matching point between from and to. The clock is read into
+ *  a local, since adel_now has to stay what it was at the start of the
+ *  pass.
+ */
+template<typename V>
+inline bool adel_ramp(uint32_t start, uint32_t T, long from, long to, V & v)
+{
+    uint32_t elapsed = adel_millis() - start;
+    if (elapsed > T) return false;
+    v = map(elapsed, 0, T, from, to);
+    return true;
+}
+
+/** Periodic scheduling
+ *
+ *  What aevery does when a run takes so long that one or more periods
+ *  pass entirely before it finishes. A period that has started but not
+ *  yet ended always gets its run, late if need be.
+ *
+ *    ADEL_CATCHUP  -- start the missed periods right away, one after the
+ *                     other, until the function is back on schedule
+ *    ADEL_SKIP     -- drop the missed periods, and start the current one
+ *    ADEL_COALESCE -- start once right away for all of the missed
+ *                     periods, and count the next period from now
+ *
+ *  Define ADEL_EVERY_POLICY to choose the policy for plain aevery.
+ */
+#define ADEL_CATCHUP  0
+#define ADEL_SKIP     1
+#define ADEL_COALESCE 2
+
+#ifndef ADEL_EVERY_POLICY
+#define ADEL_EVERY_POLICY ADEL_CATCHUP
+#endif
+
+/** adel_period
+ *
+ *  Called when a periodic function finishes at time now; next is the
+ *  start of the next period. Returns true if the function should start
+ *  again right away, or false if it should wait until next. Except after
+ *  ADEL_COALESCE, periods always start a whole number of periods after
+ *  the first one, no matter how long each run takes, so the rate does not
+ *  drift. overruns counts the periods that passed entirely before their
+ *  run started, or without one.
+ */
+inline bool adel_period(uint32_t now, uint32_t & next, uint32_t T,
+                        uint8_t policy, uint16_t & overruns)
+{
+    if (adel_before(now, next)) return false;
+    // -- Periods that ended before now; the one at next is due either way
+    uint32_t missed = (now - next) / T;
+    if (missed == 0 || policy == ADEL_CATCHUP) {
+        if (missed) overruns++;
+        next += T;
+        return true;
+    }
+    overruns += missed;
+    if (policy == ADEL_SKIP) next += (missed + 1) * T;
+    else                     next = now + T;
+    return true;
+}
 
 /** adel status
  * 
@@ -46,21 +147,849 @@ public:
     bool notdone() const { return m_status == ACONT || m_status == AYIELD; }
 };
 
+// -- Coroutine frames always come from the pool (see adelco.h). They hold
+//    every local variable, so they need larger size classes than ARs.
+#ifdef ADEL_COROUTINES
+#ifndef ADEL_POOL_BYTES
+#define ADEL_POOL_BYTES 2048
+#endif
+#ifndef ADEL_POOL_CLASSES
+#define ADEL_POOL_CLASSES 64
+#endif
+#endif
+
+#ifdef ADEL_POOL_BYTES
+
+#ifndef ADEL_POOL_GRAIN
+#define ADEL_POOL_GRAIN 8
+#endif
+
+#ifndef ADEL_POOL_CLASSES
+#define ADEL_POOL_CLASSES 16
+#endif
+
+/** Activation record pool
+ *
+ *  Optional fixed-capacity allocator for activation records, enabled by
+ *  defining ADEL_POOL_BYTES before including adel.h. Every construct that
+ *  calls an Adel function allocates a new activation record, so without
+ *  the pool a long-running program churns the heap on every iteration.
+ *
+ *  Requests are rounded up to a multiple of ADEL_POOL_GRAIN bytes, and
+ *  each rounded size has its own free list. Since the same functions are
+ *  called over and over, freed records are almost always reused by the
+ *  next call of the same size. Blocks are carved from a static arena the
+ *  first time each size is needed; when the arena is used up (or the
+ *  record is larger than the largest size class) we fall back on malloc
+ *  and count it, so that you can check for overflow on the device.
+ *
+ *  The storage lives in function-local statics so that the sketch, which
+ *  defines ADEL_POOL_BYTES, controls its size.
+ */
+class AdelPool
+{
+private:
+    // -- Free blocks are linked through their first word
+    struct block { block * next; };
+
+    static uint8_t * arena() {
+        static uint64_t storage[(ADEL_POOL_BYTES + 7) / 8];
+        return (uint8_t *) storage;
+    }
+
+    static size_t & top() { static size_t t = 0; return t; }
+
+    static block ** freelist() {
+        static block * lists[ADEL_POOL_CLASSES];
+        return lists;
+    }
+
+    static inline bool inpool(void * p) {
+        return (uint8_t *) p >= arena() && (uint8_t *) p < arena() + ADEL_POOL_BYTES;
+    }
+
+public:
+    // -- Number of allocations that could not be served from the pool
+    static uint16_t & fallbacks() { static uint16_t f = 0; return f; }
+
+    // -- Total number of allocations and bytes requested, for measuring
+    //    the cost of each construct (see examples/benchmark.ino). ARs that
+    //    reuse the memory a runtime kept (see adel_spare) count too.
+    static uint32_t & allocs() { static uint32_t n = 0; return n; }
+    static uint32_t & allocbytes() { static uint32_t n = 0; return n; }
+
+    static inline void count(size_t sz) {
+        allocs()++;
+        allocbytes() += sz;
+    }
+
+    static void * alloc(size_t sz) {
+        count(sz);
+        size_t c = (sz + ADEL_POOL_GRAIN - 1) / ADEL_POOL_GRAIN;
+        if (c > 0 && c <= ADEL_POOL_CLASSES) {
+            block *& head = freelist()[c - 1];
+            if (head) {
+                block * b = head;
+                head = b->next;
+                return b;
+            }
+            size_t bytes = c * ADEL_POOL_GRAIN;
+            if (top() + bytes <= ADEL_POOL_BYTES) {
+                void * p = arena() + top();
+                top() += bytes;
+                return p;
+            }
+        }
+        fallbacks()++;
+        return malloc(sz);
+    }
+
+    static void release(void * p, size_t sz) {
+        if (inpool(p)) {
+            size_t c = (sz + ADEL_POOL_GRAIN - 1) / ADEL_POOL_GRAIN;
+            block * b = (block *) p;
+            b->next = freelist()[c - 1];
+            freelist()[c - 1] = b;
+        } else {
+            free(p);
+        }
+    }
+};
+
+#endif
+
+#ifdef ADEL_TRACE
+
+/** Trace buffer
+ *
+ *  Optional record of the constructs that Adel functions go through,
+ *  enabled by defining ADEL_TRACE before including adel.h as the number of
+ *  events to keep (a power of two). Unlike ADEL_DEBUG, nothing is printed
+ *  while the program runs: each event is four stores into a ring buffer
+ *  in RAM, so tracing barely changes the timing it is meant to show. The
+ *  function and construct names are pointers to the string constants.
+ *  When the buffer is full the oldest events are overwritten.
+ *
+ *  Each event also records the activation record (or coroutine frame)
+ *  it belongs to. Besides the constructs, every pass through a function
+ *  records a "resume" and a "suspend" event, and deleting the record
+ *  records "free", so that the passes of each function can be shown on
+ *  a track of their own.
+ *
+ *  adel_trace_dump() prints the buffer over Serial, oldest event first.
+ *  extras/adeltrace.py turns the dump into a timeline, or into Chrome
+ *  trace JSON for chrome://tracing or ui.perfetto.dev.
+ */
+struct AdelTraceEvent
+{
+    uint32_t t;
+    const void * ar;
+    const char * fn;
+    const char * kind;
+    uint16_t line;
+};
+
+class AdelTrace
+{
+    static_assert(ADEL_TRACE > 0 && (ADEL_TRACE & (ADEL_TRACE - 1)) == 0,
+                  "ADEL_TRACE must be a power of two");
+
+    static AdelTraceEvent * ring() {
+        static AdelTraceEvent events[ADEL_TRACE];
+        return events;
+    }
+
+public:
+    // -- Number of events recorded since the last clear
+    static uint32_t & count() { static uint32_t n = 0; return n; }
+
+    // -- The coroutine that is running (see adelco.h)
+    static const void *& current() { static const void * c = 0; return c; }
+
+    static inline void record(const void * ar, const char * fn, const char * kind,
+                              uint16_t line) {
+        AdelTraceEvent & e = ring()[count() & (ADEL_TRACE - 1)];
+        e.t = adel_micros();
+        e.ar = ar;
+        e.fn = fn;
+        e.kind = kind;
+        e.line = line;
+        count()++;
+    }
+
+    static void clear() { count() = 0; }
+
+    // -- One line per event: time in microseconds, record, function, line,
+    //    and construct. The first line gives the number of events lost.
+    static void dump() {
+        uint32_t n = count();
+        uint32_t from = n > ADEL_TRACE ? n - ADEL_TRACE : 0;
+        Serial.print("adeltrace,");
+        Serial.println(from);
+        for (uint32_t i = from; i < n; i++) {
+            const AdelTraceEvent & e = ring()[i & (ADEL_TRACE - 1)];
+            Serial.print(e.t);
+            Serial.print(",");
+            Serial.print((unsigned long) (uintptr_t) e.ar);
+            Serial.print(",");
+            Serial.print(e.fn ? e.fn : "-");
+            Serial.print(",");
+            Serial.print(e.line);
+            Serial.print(",");
+            Serial.println(e.kind);
+        }
+        Serial.println("end");
+    }
+};
+
+inline void adel_trace_dump() { AdelTrace::dump(); }
+
+#endif
+
+#ifdef ADEL_PROFILE
+
+/** Profiler
+ *
+ *  Optional per-function statistics, enabled by defining ADEL_PROFILE
+ *  before including adel.h as the number of different functions to keep
+ *  track of. For each function it counts the calls and the passes through
+ *  its body, and adds up the time spent in the body on each pass, not
+ *  counting the time spent in the functions it is waiting for. Functions
+ *  beyond the first ADEL_PROFILE are not measured.
+ *
+ *  adel_profile_dump() prints the table over Serial as CSV.
+ */
+struct AdelProfileEntry
+{
+    const char * name;
+    uint32_t calls;
+    uint32_t passes;
+    uint32_t total;
+    uint32_t max;
+};
+
+class AdelProfile
+{
+    static AdelProfileEntry * table() {
+        static AdelProfileEntry entries[ADEL_PROFILE];
+        return entries;
+    }
+
+    static uint8_t & used() { static uint8_t n = 0; return n; }
+
+    // -- Time spent so far in the callees of the pass being measured
+    static uint32_t & inner() { static uint32_t t = 0; return t; }
+
+public:
+    // -- The entry for the function that started most recently, which
+    //    AdelTask picks up after the first pass (see adelco.h)
+    static AdelProfileEntry *& started() { static AdelProfileEntry * e = 0; return e; }
+
+    // -- Find or add the entry for a function. Called once per function,
+    //    so a linear search is fine. Different instances of a template
+    //    function share an entry.
+    static AdelProfileEntry * slot(const char * name) {
+        for (uint8_t i = 0; i < used(); i++) {
+            if (strcmp(table()[i].name, name) == 0) return & table()[i];
+        }
+        if (used() == ADEL_PROFILE) return 0;
+        AdelProfileEntry & e = table()[used()++];
+        e.name = name;
+        return & e;
+    }
+
+    // -- Measures one pass through a function body
+    class pass
+    {
+        uint32_t start;
+        uint32_t outer;
+
+    public:
+        pass() : start(adel_micros()), outer(inner()) { inner() = 0; }
+
+        void done(AdelProfileEntry * e) {
+            uint32_t elapsed = adel_micros() - start;
+            if (e) {
+                uint32_t self = elapsed - inner();
+                e->passes++;
+                e->total += self;
+                if (self > e->max) e->max = self;
+            }
+            inner() = outer + elapsed;
+        }
+    };
+
+    // -- Passes through all of the measured function bodies so far
+    static uint32_t passes() {
+        uint32_t n = 0;
+        for (uint8_t i = 0; i < used(); i++) n += table()[i].passes;
+        return n;
+    }
+
+    static void clear() {
+        for (uint8_t i = 0; i < used(); i++) {
+            AdelProfileEntry & e = table()[i];
+            e.calls = e.passes = e.total = e.max = 0;
+        }
+    }
+
+    static void dump() {
+        Serial.println("function,calls,passes,total_us,max_us,mean_us");
+        for (uint8_t i = 0; i < used(); i++) {
+            const AdelProfileEntry & e = table()[i];
+            Serial.print(e.name);
+            Serial.print(",");
+            Serial.print(e.calls);
+            Serial.print(",");
+            Serial.print(e.passes);
+            Serial.print(",");
+            Serial.print(e.total);
+            Serial.print(",");
+            Serial.print(e.max);
+            Serial.print(",");
+            Serial.println(e.passes ? e.total / e.passes : 0);
+        }
+    }
+};
+
+inline void adel_profile_dump() { AdelProfile::dump(); }
+
+#endif
+
+// -- Reasons an activation record can be asleep (see AdelSleep), and the
+//    time adel_idle passes to sleepfn when there is no deadline at all
+#define ADEL_TIMED   1
+#define ADEL_BLOCKED 2
+#define ADEL_QUEUED  4
+#define ADEL_FOREVER 0xFFFFFFFF
+
+/** adel_atomic
+ *
+ *  Run the block that follows with interrupts masked, on processors where
+ *  reading or writing more than one byte is not a single instruction. The
+ *  interrupt state is restored afterwards, so it is safe in an interrupt
+ *  handler too.
+ */
+#ifdef __AVR__
+#include <util/atomic.h>
+#define adel_atomic ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#define adel_atomic
+#endif
+
+/** AdelEvent
+ *
+ *  An event that Adel functions can wait for with await_event, and that
+ *  any code -- including an interrupt handler -- can signal. Unlike await,
+ *  a function waiting for an event is parked: it is not run at all until
+ *  some event is signalled, at which point it checks whether its own event
+ *  has happened.
+ *
+ *  Each signal is delivered to exactly one await_event. The count of
+ *  signals is only written by signal() and the count of deliveries only by
+ *  await_event, so no locking is needed, as long as a given event is
+ *  signalled either from interrupt handlers or from regular code, but not
+ *  both.
+ */
+class AdelEvent
+{
+public:
+    // -- Bumped by every signal, so that parked functions know to look again.
+    //    A parked function misses its wakeup only if exactly a multiple of
+    //    65536 signals (and puts and gets) happen between two looks, so
+    //    the count is 16 bits wide, and is read and bumped with interrupts
+    //    masked where that takes more than one instruction.
+    static volatile uint16_t epoch;
+
+    static inline uint16_t current() {
+        uint16_t e;
+        adel_atomic { e = epoch; }
+        return e;
+    }
+
+    static inline void bump() {
+        adel_atomic { epoch = epoch + 1; }
+    }
+
+private:
+    volatile uint8_t signals;
+    uint8_t taken;
+
+public:
+    AdelEvent()
+        : signals(0),
+          taken(0)
+        {}
+
+    // -- Signal the event. Safe to call from an interrupt handler.
+    inline void signal() {
+        signals = signals + 1;
+        bump();
+    }
+
+    // -- Is there a signal that has not been delivered yet?
+    inline bool pending() const { return signals != taken; }
+
+    // -- Consume one signal, if there is one
+    inline bool take() {
+        if (signals == taken) return false;
+        taken++;
+        return true;
+    }
+};
+
+/** adel_barrier
+ *
+ *  Keep the compiler from moving memory accesses across this point. Used
+ *  when a value is handed to (or from) an interrupt handler, so that the
+ *  data is written before the index that publishes it.
+ */
+#define adel_barrier() __asm__ __volatile__("" ::: "memory")
+
+/** AdelChannel
+ *
+ *  A fixed-size queue of N values of type T from one producer to one
+ *  consumer, for passing data from an interrupt handler to an Adel
+ *  function (or the other way) without losing values that arrive close
+ *  together. Adel functions use asend and areceive, which park the
+ *  function while the channel is full or empty; an interrupt handler
+ *  calls put() or get() directly, which never wait.
+ *
+ *  The producer only writes head and the consumer only writes tail, so
+ *  no locking is needed as long as there really is just one of each. N
+ *  must be a power of two, no larger than 128.
+ */
+template<typename T, uint8_t N>
+class AdelChannel
+{
+    static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0,
+                  "AdelChannel size must be a power of two up to 128");
+
+private:
+    T items[N];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+
+public:
+    AdelChannel()
+        : head(0),
+          tail(0)
+        {}
+
+    inline uint8_t count() const { return (uint8_t)(head - tail); }
+    inline bool empty() const { return head == tail; }
+    inline bool full() const { return count() == N; }
+
+    // -- Add v to the channel, unless it is full. Wakes up a parked
+    //    consumer.
+    inline bool put(const T & v) {
+        uint8_t h = head;
+        if ((uint8_t)(h - tail) == N) return false;
+        items[h & (N - 1)] = v;
+        adel_barrier();
+        head = h + 1;
+        AdelEvent::bump();
+        return true;
+    }
+
+    // -- Take the oldest value out of the channel, unless it is empty.
+    //    Wakes up a parked producer.
+    inline bool get(T & v) {
+        uint8_t t = tail;
+        if (head == t) return false;
+        v = items[t & (N - 1)];
+        adel_barrier();
+        tail = t + 1;
+        AdelEvent::bump();
+        return true;
+    }
+};
+
+/** AdelQueue
+ *
+ *  A fixed-size queue of up to N values of type T for passing data
+ *  between Adel functions, with aput and aget. Any number of functions
+ *  can put into or get from the same queue, in the same runtime or in
+ *  different ones, since Adel functions never run at the same time. Not
+ *  for use in interrupt handlers -- see AdelChannel for that.
+ */
+template<typename T, uint8_t N>
+class AdelQueue
+{
+private:
+    T items[N];
+    uint8_t first;
+    uint8_t n;
+
+public:
+    AdelQueue()
+        : first(0),
+          n(0)
+        {}
+
+    inline uint8_t count() const { return n; }
+    inline bool empty() const { return n == 0; }
+    inline bool full() const { return n == N; }
+
+    // -- Add v at the end of the queue, unless it is full. Wakes up
+    //    parked functions so that a waiting aget can take it.
+    inline bool put(const T & v) {
+        if (n == N) return false;
+        uint8_t i = first + n;
+        if (i >= N) i -= N;
+        items[i] = v;
+        n++;
+        AdelEvent::bump();
+        return true;
+    }
+
+    // -- Take the value at the front of the queue, unless it is empty
+    inline bool get(T & v) {
+        if (n == 0) return false;
+        v = items[first];
+        if (++first == N) first = 0;
+        n--;
+        AdelEvent::bump();
+        return true;
+    }
+};
+
+#ifndef ADEL_MAX_WAITERS
+#define ADEL_MAX_WAITERS 4
+#endif
+
+/** AdelSleep
+ *
+ *  The sleep state of an Adel function (see AdelAR, and the promise in
+ *  adelco.h). While sleeping is set, neither the function nor any of its
+ *  children has anything to do, and the caller skips the whole subtree.
+ *  ADEL_TIMED means wait until time wake; ADEL_BLOCKED means wait until
+ *  some AdelEvent is signalled after the given epoch; ADEL_QUEUED means
+ *  wait until another function calls wakeup(). With more than one set,
+ *  any of them wakes the function up.
+ *
+ *  parent is the caller, which is parked on this function, so wakeup()
+ *  wakes the callers up too, all the way to the top.
+ */
+struct AdelSleep
+{
+    uint32_t wake;
+    uint16_t epoch;
+    uint8_t sleeping;
+    AdelSleep * parent;
+
+    AdelSleep()
+        : wake(0),
+          epoch(0),
+          sleeping(0),
+          parent(0)
+        {}
+
+    inline ~AdelSleep();
+
+    inline void wakeup() {
+        for (AdelSleep * s = this; s; s = s->parent) s->sleeping = 0;
+    }
+};
+
+/** AdelSemaphore
+ *
+ *  A counting semaphore for sharing something, like a bus, among Adel
+ *  functions, with aacquire and arelease. Functions that have to wait
+ *  are served in the order they arrived: release hands the permit
+ *  straight to the function at the front of the line, so it does not
+ *  have to compete for it with functions that arrive later, and wakes
+ *  up that function alone. The line is kept here rather than in the
+ *  functions, which only need room for it while they are waiting.
+ *
+ *  The semaphore also remembers which functions hold its permits, so
+ *  that a function that ends without giving its permit back -- because
+ *  auntil or aforatmost stopped it, say -- gives it back anyway (see
+ *  forget).
+ *
+ *  At most ADEL_MAX_WAITERS functions wait in line. Beyond that, they
+ *  try again on every pass. Likewise, only the first ADEL_MAX_WAITERS
+ *  holders are remembered.
+ */
+class AdelSemaphore
+{
+private:
+    uint8_t permits;
+    uint8_t nwaiting;
+
+    // -- The first ngranted functions in line have been handed a permit,
+    //    and take it on their next pass
+    uint8_t ngranted;
+    AdelSleep * waiters[ADEL_MAX_WAITERS];
+
+    uint8_t nholding;
+    AdelSleep * holders[ADEL_MAX_WAITERS];
+
+    AdelSemaphore * next;
+
+public:
+    // -- List of all semaphores, and the number of functions waiting on
+    //    or holding any of them, so that a function that ends while it is
+    //    on one of the lists can be taken off (see forget)
+    static AdelSemaphore * first;
+    static uint16_t alllisted;
+
+    AdelSemaphore(uint8_t initial = 1)
+        : permits(initial),
+          nwaiting(0),
+          ngranted(0),
+          nholding(0),
+          next(first)
+    {
+        first = this;
+    }
+
+    ~AdelSemaphore() {
+        alllisted -= nwaiting + nholding;
+        AdelSemaphore ** pos = & first;
+        while (*pos != this) pos = & (*pos)->next;
+        *pos = next;
+    }
+
+    inline uint8_t available() const { return permits; }
+    inline uint8_t waiting() const { return nwaiting; }
+
+    // -- Try to get a permit for w. Returns true once it has one;
+    //    otherwise w is in line (see queued), or the line is full.
+    inline bool acquire(AdelSleep * w) {
+        uint8_t i = find(waiters, nwaiting, w);
+        if (i < nwaiting) {
+            if (i >= ngranted) return false;
+            remove(waiters, nwaiting, i);
+            ngranted--;
+            hold(w);
+            return true;
+        }
+        if (permits > 0) {
+            permits--;
+            hold(w);
+            return true;
+        }
+        if (nwaiting < ADEL_MAX_WAITERS) {
+            waiters[nwaiting++] = w;
+            alllisted++;
+        }
+        return false;
+    }
+
+    // -- Is w waiting in line?
+    inline bool queued(const AdelSleep * w) const {
+        return find(waiters, nwaiting, w) < nwaiting;
+    }
+
+    // -- Give a permit back: w no longer holds it. It goes to the first
+    //    function in line that does not have one yet, or back in the
+    //    pile.
+    inline void release(const AdelSleep * w = 0) {
+        uint8_t i = find(holders, nholding, w);
+        if (i < nholding) remove(holders, nholding, i);
+        if (ngranted < nwaiting) waiters[ngranted++]->wakeup();
+        else permits++;
+    }
+
+    // -- Take w off every list it is on, giving back the permits it holds
+    //    or was handed (see ~AdelSleep)
+    static void forget(const AdelSleep * w) {
+        for (AdelSemaphore * s = first; s; s = s->next) {
+            uint8_t i = find(s->waiters, s->nwaiting, w);
+            if (i < s->nwaiting) {
+                s->remove(s->waiters, s->nwaiting, i);
+                if (i < s->ngranted) {
+                    s->ngranted--;
+                    s->release();
+                }
+            }
+            while (find(s->holders, s->nholding, w) < s->nholding)
+                s->release(w);
+        }
+    }
+
+private:
+    inline void hold(AdelSleep * w) {
+        if (nholding < ADEL_MAX_WAITERS) {
+            holders[nholding++] = w;
+            alllisted++;
+        }
+    }
+
+    static inline uint8_t find(AdelSleep * const * list, uint8_t n, const AdelSleep * w) {
+        uint8_t i = 0;
+        while (i < n && list[i] != w) i++;
+        return i;
+    }
+
+    static inline void remove(AdelSleep ** list, uint8_t & n, uint8_t i) {
+        n--;
+        alllisted--;
+        for (; i < n; i++) list[i] = list[i + 1];
+    }
+};
+
+/** AdelMutex
+ *
+ *  A semaphore with a single permit: only one function at a time.
+ */
+class AdelMutex : public AdelSemaphore
+{
+public:
+    AdelMutex() : AdelSemaphore(1) {}
+};
+
+inline AdelSleep::~AdelSleep()
+{
+    if (AdelSemaphore::alllisted) AdelSemaphore::forget(this);
+}
+
+#ifdef ADEL_COROUTINES
+#include "adelco.h"
+#else
+
+#ifdef ADEL_MEMSTATS
+
+/** Memory accounting
+ *
+ *  Optional statistics on activation records, enabled by defining
+ *  ADEL_MEMSTATS before including adel.h. Each AR records its size in
+ *  bytes and is counted three times: in the total over all ARs, in the
+ *  runtime that was running when it was allocated (see
+ *  AdelRuntime::memory), and in the Adel function it belongs to. For each
+ *  of these, the counters keep the number of live ARs and their bytes,
+ *  and the highest each has reached. This is what you need to size
+ *  ADEL_POOL_BYTES and to check that a runtime goes back to zero (no
+ *  leaks) when its function finishes.
+ */
+struct AdelMemStats
+{
+    uint16_t live;
+    uint16_t peaklive;
+    uint32_t bytes;
+    uint32_t peakbytes;
+
+    AdelMemStats()
+        : live(0),
+          peaklive(0),
+          bytes(0),
+          peakbytes(0)
+        {}
+
+    inline void add(uint16_t sz) {
+        live++;
+        bytes += sz;
+        if (live > peaklive) peaklive = live;
+        if (bytes > peakbytes) peakbytes = bytes;
+    }
+
+    inline void remove(uint16_t sz) {
+        live--;
+        bytes -= sz;
+    }
+
+    // -- Every AR in the program
+    static AdelMemStats & total() { static AdelMemStats t; return t; }
+
+    // -- The counters, at the end of a row of adel_memory_dump
+    void print() const {
+        Serial.print(",");
+        Serial.print(live);
+        Serial.print(",");
+        Serial.print(bytes);
+        Serial.print(",");
+        Serial.print(peaklive);
+        Serial.print(",");
+        Serial.println(peakbytes);
+    }
+
+    // -- The AR is allocated before it is constructed, so operator new
+    //    leaves the size here for the constructor
+    static size_t & lastsize() { static size_t s = 0; return s; }
+};
+
+/** AdelMemFunction
+ *
+ *  The statistics for one Adel function, which abegin keeps in a static
+ *  variable. They form a list, like the runtimes, for adel_memory_dump.
+ *  size is the size of the function's AR, which is fixed by the variables
+ *  it declares above abegin.
+ */
+struct AdelMemFunction : public AdelMemStats
+{
+    const char * name;
+    uint16_t size;
+    AdelMemFunction * next;
+
+    static AdelMemFunction *& first() { static AdelMemFunction * f = 0; return f; }
+
+    AdelMemFunction(const char * n)
+        : name(n),
+          size(0),
+          next(first())
+    {
+        first() = this;
+    }
+};
+
+// -- The counters of the current runtime, if any (see AdelRuntime)
+inline AdelMemStats * adel_memowner();
+
+#endif
+
+template<typename T> class LocalAdelAR;
+
+// -- Memory the current runtime kept for an AR of size sz, or null (see
+//    AdelRuntime::reset)
+inline void * adel_spare(size_t sz);
+
 /** Adel activation record
  *
  *  The base class for all activation records. All other information --
  *  including the code to run -- is bound up in the closure stored in each
  *  subclass.
  */
-class AdelAR
+class AdelAR : public AdelSleep
 {
 private:
     // -- Each Adel function can have up three callees running simulatenously
     //    (see athree, for example)
     AdelAR * children[3];
 
+    // -- Set while the function is being stopped, so that it runs its
+    //    afinally block instead of its next step
+    bool stopped;
+
 public:
-    AdelAR() {
+#ifdef ADEL_PROFILE
+    // -- Where to add up the time spent in this function (see abegin)
+    AdelProfileEntry * prof;
+#endif
+
+#ifdef ADEL_MEMSTATS
+    // -- Size of this AR, and the counters it is included in. fn is set on
+    //    the first pass (see account).
+    uint16_t size;
+    AdelMemStats * owner;
+    AdelMemFunction * fn;
+#endif
+
+    AdelAR()
+        : AdelSleep(),
+          stopped(false)
+    {
+#ifdef ADEL_PROFILE
+        prof = 0;
+#endif
+#ifdef ADEL_MEMSTATS
+        size = AdelMemStats::lastsize();
+        AdelMemStats::lastsize() = 0;
+        owner = adel_memowner();
+        fn = 0;
+        AdelMemStats::total().add(size);
+        if (owner) owner->add(size);
+#endif
         children[0] = 0;
         children[1] = 0;
         children[2] = 0;
@@ -72,6 +1001,7 @@ public:
     inline void init(int i, AdelAR * ar) {
         clear(i);
         children[i] = ar;
+        if (ar) ar->parent = this;
     }
 
     // -- Clear a particular child function, deleting its activation record
@@ -87,15 +1017,197 @@ public:
     //    function to invoke its lambda.
     virtual astatus run() = 0;
 
+    // -- Does this function need to run on this pass?
+    inline bool ready() const {
+        if ( ! sleeping) return true;
+        if ((sleeping & ADEL_BLOCKED) && epoch != AdelEvent::current()) return true;
+        if ((sleeping & ADEL_TIMED) && ! adel_before(adel_now, wake)) return true;
+        return false;
+    }
+
+    // -- Is the function being stopped before it finished? (see afinally)
+    inline bool stopping() const { return stopped; }
+    inline void stop() { stopped = true; }
+
+    // -- Wake the function up if it is time. Returns false if it is still
+    //    asleep.
+    inline bool awake() {
+        if (sleeping) {
+            if ( ! ready()) return false;
+            sleeping = 0;
+        }
+        return true;
+    }
+
+    // -- Run the function unless it is asleep. A sleeping function would
+    //    just return ACONT anyway, so we skip the call altogether.
+    inline astatus step() {
+        if ( ! awake()) return astatus::ACONT;
+        return run();
+    }
+
     // -- Most of the time, the parent AR calls run
-    inline astatus runchild(int i) const { return children[i]->run(); }
+    inline astatus runchild(int i) const { return children[i]->step(); }
+
+    // -- The constructs also pass a null pointer with the static type of
+    //    the callee (see adel_as). When it is a LocalAdelAR, as it is with
+    //    ADEL_STATIC, we call its body directly instead of through the
+    //    virtual run(), so the compiler can inline the whole tree.
+    inline astatus runchild(int i, AdelAR *) const { return children[i]->step(); }
+
+    template<typename T>
+    inline astatus runchild(int i, LocalAdelAR<T> *) const {
+        return static_cast<LocalAdelAR<T> *>(children[i])->steplocal();
+    }
+
+    // -- Is this function (and everything below it) asleep, and on what
+    inline uint8_t asleep() const { return sleeping; }
+    inline uint32_t waketime() const { return wake; }
+    inline uint16_t sleepepoch() const { return epoch; }
+
+    // -- Put this function to sleep until time t (see adelay)
+    inline void sleep(uint32_t t) {
+        wake = t;
+        sleeping = ADEL_TIMED;
+    }
+
+    // -- Put this function to sleep until an event is signalled. The epoch
+    //    must be read *before* checking the event, so that a signal that
+    //    arrives in between is not missed (see await_event).
+    inline void block(uint16_t ep) {
+        epoch = ep;
+        sleeping = ADEL_BLOCKED;
+    }
+
+    // -- Put this function to sleep until another function wakes it up
+    //    (see aacquire)
+    inline void hold() { sleeping = ADEL_QUEUED; }
+
+    // -- Go to sleep on whatever the children were waiting for (see
+    //    parked)
+    inline void park(uint8_t how, uint32_t t, uint16_t ep) {
+        sleeping = how;
+        wake = t;
+        epoch = ep;
+    }
+
+    // -- Wake up no later than time t (see aforatmost)
+    inline void wakeby(uint32_t t) {
+        if (sleeping) {
+            if ( ! (sleeping & ADEL_TIMED) || adel_before(t, wake)) wake = t;
+            sleeping |= ADEL_TIMED;
+        }
+    }
+
+    // -- Add a child that is still running to the combined sleep state of
+    //    a group of children: how is the union of the reasons they are
+    //    waiting, and t is the earliest deadline. Returns false if the
+    //    child needs to run on the next pass, in which case the parent
+    //    must stay awake.
+    static inline bool parked(const AdelAR * ch, astatus s, uint16_t ep,
+                              uint8_t & how, uint32_t & t) {
+        if ( ! s.cont() || ! ch->sleeping) return false;
+        if ((ch->sleeping & ADEL_BLOCKED) && ch->epoch != ep) return false;
+        if (ch->sleeping & ADEL_TIMED) {
+            if ( ! (how & ADEL_TIMED) || adel_before(ch->wake, t)) t = ch->wake;
+        }
+        how |= ch->sleeping;
+        return true;
+    }
+
+    // -- Called when a construct is still waiting for its children, given
+    //    the status of each one. If every child that is still running is
+    //    asleep, then so is this function, until the earliest of them
+    //    wakes up. A child that needs polling keeps us awake.
+    inline void waitchildren(astatus s0,
+                             astatus s1 = astatus::ADONE,
+                             astatus s2 = astatus::ADONE) {
+        astatus s[3] = { s0, s1, s2 };
+        uint16_t ep = AdelEvent::current();
+        uint8_t how = 0;
+        uint32_t t = 0;
+        for (int i = 0; i < 3; i++) {
+            if (s[i].notdone() && ! parked(children[i], s[i], ep, how, t)) return;
+        }
+        if (how) park(how, t, ep);
+    }
+
+    // -- Result slot, for functions that return adel_of<T> (see
+    //    ResultAdelAR). areturn passes its value in the widest type of
+    //    its kind (see adel_carrier), and the slot converts it to T.
+    virtual void setresult(long long) {}
+    virtual void setresult(unsigned long long) {}
+    virtual void setresult(long double) {}
+    virtual void * result() { return 0; }
+    inline void * childresult(int i) const { return children[i]->result(); }
+
+#ifdef ADEL_MEMSTATS
+    // -- Count this AR for the function it belongs to
+    inline void account(AdelMemFunction * f) {
+        fn = f;
+        fn->size = size;
+        fn->add(size);
+    }
+#endif
 
     // -- Delete this AR, and the ARs of all of its children functions
     virtual ~AdelAR() {
         clear(0);
         clear(1);
         clear(2);
+#ifdef ADEL_MEMSTATS
+        AdelMemStats::total().remove(size);
+        if (owner) owner->remove(size);
+        if (fn) fn->remove(size);
+#endif
+    }
+
+    // -- Allocate ARs from the pool, if there is one. When a top-level
+    //    function finishes, its runtime keeps the memory of the root AR
+    //    instead of freeing it (see retiring), and the next AR of the same
+    //    size in that runtime goes right back into it (see adel_spare), so
+    //    arepeat does not allocate anything in the steady state. The
+    //    destructor is virtual, so delete passes the size of the actual
+    //    LocalAdelAR.
+    static void * operator new(size_t sz) {
+#ifdef ADEL_MEMSTATS
+        AdelMemStats::lastsize() = sz;
+#endif
+        void * p = adel_spare(sz);
+#ifdef ADEL_POOL_BYTES
+        if (p) {
+            AdelPool::count(sz);
+            return p;
+        }
+        return AdelPool::alloc(sz);
+#else
+        if (p) return p;
+        return malloc(sz);
+#endif
+    }
+
+    static void operator delete(void * p, size_t sz) {
+        if (p == retiring()) {
+            retiring() = 0;
+            retiredsize() = sz;
+            return;
+        }
+        release(p, sz);
     }
+
+    static void release(void * p, size_t sz) {
+#ifdef ADEL_POOL_BYTES
+        AdelPool::release(p, sz);
+#else
+        (void) sz;
+        free(p);
+#endif
+    }
+
+    // -- Set to an AR just before deleting it, to keep its memory. delete
+    //    leaves the size in retiredsize.
+    static void *& retiring() { static void * r = 0; return r; }
+    static size_t & retiredsize() { static size_t s = 0; return s; }
 };
 
 /** LocalAdelAR
@@ -106,25 +1218,250 @@ public:
  *  the arguments to the function, creating the effect of local variables
  *  that persist as the function makes progress.
  *
- *  The templating is necessary to get around the fact that C++11/14 do not
- *  allow you to declare the type of a lambda.
+ *  The templating is necessary to get around the fact that C++11/14 do not
+ *  allow you to declare the type of a lambda.
+ */
+template<typename T>
+class LocalAdelAR : public AdelAR
+{
+public:
+    T body;
+  
+    LocalAdelAR(const T& the_lambda)
+        : AdelAR(),
+          body(the_lambda)
+        {}
+
+    // -- Stop the children first, then give the function a chance to run
+    //    its afinally block. The body returns right away if the function
+    //    never started, or already finished.
+    virtual ~LocalAdelAR() {
+        clear(0);
+        clear(1);
+        clear(2);
+        stop();
+        body(this);
+#ifdef ADEL_TRACE
+        AdelTrace::record(this, 0, "free", 0);
+#endif
+    }
+
+    // -- Invoke the lambda, passing its own AR pointer, so it can create and
+    //    attach ARs for children functions.
+    inline astatus call() {
+#ifdef ADEL_TRACE
+        AdelTrace::record(this, 0, "resume", 0);
+#endif
+#ifdef ADEL_PROFILE
+        AdelProfile::pass p;
+#endif
+        astatus s = body(this);
+#ifdef ADEL_PROFILE
+        p.done(prof);
+#endif
+#ifdef ADEL_TRACE
+        AdelTrace::record(this, 0, "suspend", 0);
+#endif
+        return s;
+    }
+
+    virtual astatus run() { return call(); }
+
+    // -- Same as step(), for callers that know the type (see runchild)
+    inline astatus steplocal() {
+        if ( ! awake()) return astatus::ACONT;
+        return call();
+    }
+};
+
+/** adel_carrier
+ *
+ *  The type that areturn uses to hand a value of type V to the result
+ *  slot: the widest signed, unsigned, or floating-point type. V is the
+ *  promoted type of the value, so smaller integers, bool, and plain enums
+ *  arrive as int. Values that are not numbers have no carrier, which
+ *  makes such an areturn a compile-time error.
+ */
+template<typename V> struct adel_carrier;
+template<> struct adel_carrier<int> { typedef long long type; };
+template<> struct adel_carrier<long> { typedef long long type; };
+template<> struct adel_carrier<long long> { typedef long long type; };
+template<> struct adel_carrier<unsigned int> { typedef unsigned long long type; };
+template<> struct adel_carrier<unsigned long> { typedef unsigned long long type; };
+template<> struct adel_carrier<unsigned long long> { typedef unsigned long long type; };
+template<> struct adel_carrier<float> { typedef long double type; };
+template<> struct adel_carrier<double> { typedef long double type; };
+template<> struct adel_carrier<long double> { typedef long double type; };
+
+/** adel_of
+ *
+ *  Return type for Adel functions that produce a value of type T with
+ *  areturn, which the caller picks up with andthen_get. It is just the
+ *  AR, plus the type of the result. T is a number type, bool, or an enum.
+ */
+template<typename T>
+class adel_of
+{
+public:
+    typedef T type;
+
+    AdelAR * ar;
+
+    adel_of(AdelAR * the_ar) : ar(the_ar) {}
+
+    operator AdelAR * () const { return ar; }
+};
+
+/** ResultAdelAR
+ *
+ *  A LocalAdelAR with room for the result of the function, so that
+ *  returning a value needs no extra allocation. Each one converts from
+ *  all three carriers, whatever the function actually returns, so on
+ *  small processors the first adel_of brings in the library code for
+ *  64-bit integers and long double.
+ */
+template<typename T, typename R>
+class ResultAdelAR final : public LocalAdelAR<T>
+{
+public:
+    R value;
+
+    ResultAdelAR(const T& the_lambda)
+        : LocalAdelAR<T>(the_lambda),
+          value()
+        {}
+
+    virtual void setresult(long long v) { value = (R) v; }
+    virtual void setresult(unsigned long long v) { value = (R) v; }
+    virtual void setresult(long double v) { value = (R) v; }
+
+    virtual void * result() { return & value; }
+};
+
+/** AdelMaker
+ *
+ *  What aend returns: the lambda, waiting to be put in an AR of the right
+ *  kind for the function's return type. Normally it is converted right
+ *  away, in the return statement, so it can refer to the lambda. With
+ *  ADEL_STATIC, the function returns the maker itself, and the caller
+ *  converts it (see adel_as), so it needs its own copy.
+ */
+template<typename T>
+class AdelMaker
+{
+public:
+#ifdef ADEL_STATIC
+    T body;
+#else
+    const T & body;
+#endif
+
+    AdelMaker(const T & the_lambda) : body(the_lambda) {}
+
+    operator AdelAR * () const { return new LocalAdelAR<T>(body); }
+
+    template<typename R>
+    operator adel_of<R> () const { return adel_of<R>(new ResultAdelAR<T, R>(body)); }
+};
+
+template<typename T>
+inline AdelMaker<T> adel_make(const T & the_lambda) { return AdelMaker<T>(the_lambda); }
+
+// -- The static type of the AR that an Adel function call creates (see
+//    adel_as). Only used in decltype, so there are no definitions.
+AdelAR * adel_artype(AdelAR * ar);
+template<typename T>
+LocalAdelAR<T> * adel_artype(const AdelMaker<T> & m);
+
+/** GroupAdelAR
+ *
+ *  Activation record for aall, aany and aforeach, which run any number of
+ *  functions at the same time. The functions are kept in a flat array
+ *  whose size is known at compile time, and each pass runs them in a
+ *  single loop, so a wide fan-out costs one extra AR instead of a tree of
+ *  nested aboth calls. Only the first "count" entries are used, which
+ *  lets aforeach decide at run time how many functions to start. In "any"
+ *  mode the group is done as soon as one function is done; otherwise it
+ *  waits for all of them. Functions that finish early are deleted right
+ *  away.
  */
-template<typename T>
-class LocalAdelAR : public AdelAR
+template<size_t N>
+class GroupAdelAR : public AdelAR
 {
+    static_assert(N <= 255, "aall, aany and aforeach run at most 255 functions");
+
+private:
+    AdelAR * members[N];
+    uint8_t count;
+    bool any;
+
 public:
-    T body;
-  
-    LocalAdelAR(const T& the_lambda)
+    GroupAdelAR(bool is_any, uint8_t how_many)
         : AdelAR(),
-          body(the_lambda)
-        {}
+          count(how_many < N ? how_many : N),
+          any(is_any)
+    {
+        for (uint8_t i = 0; i < N; i++) members[i] = 0;
+    }
 
-    // -- Invoke the lambda, passing its own AR pointer, so it can create and
-    //    attach ARs for children functions.
-    virtual astatus run() { return body(this); }
+    inline void set(uint8_t i, AdelAR * ar) {
+        members[i] = ar;
+        if (ar) ar->parent = this;
+    }
+
+    virtual astatus run() {
+        bool running = false;
+        bool asleep = true;
+        uint16_t ep = AdelEvent::current();
+        uint8_t how = 0;
+        uint32_t t = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            AdelAR * m = members[i];
+            if ( ! m) continue;
+            astatus s = m->step();
+            if (s.done()) {
+                if (any) return astatus::ADONE;
+                members[i] = 0;
+                delete m;
+            } else {
+                // -- Same rule as waitchildren: sleep only if every
+                //    function still running is asleep
+                if ( ! parked(m, s, ep, how, t)) asleep = false;
+                running = true;
+            }
+        }
+        if ( ! running) return astatus::ADONE;
+        if (asleep) park(how, t, ep);
+        return astatus::ACONT;
+    }
+
+    virtual ~GroupAdelAR() {
+        for (uint8_t i = 0; i < count; i++) delete members[i];
+    }
 };
 
+// -- Make a group AR from a list of calls to Adel functions
+template<typename... Fs>
+inline AdelAR * adel_group(bool any, Fs... fs)
+{
+    AdelAR * const ars[] = { fs... };
+    GroupAdelAR<sizeof...(Fs)> * g = new GroupAdelAR<sizeof...(Fs)>(any, sizeof...(Fs));
+    for (uint8_t i = 0; i < sizeof...(Fs); i++) g->set(i, ars[i]);
+    return g;
+}
+
+// -- Make a group AR that calls fn on the first count elements of an
+//    array. The size of the array fixes the size of the group, and count
+//    is cut down to fit it.
+template<typename T, size_t N, typename F>
+inline AdelAR * adel_foreach(T (&elements)[N], int count, F fn)
+{
+    uint8_t n = count < 0 ? 0 : ((size_t) count < N ? count : N);
+    GroupAdelAR<N> * g = new GroupAdelAR<N>(false, n);
+    for (uint8_t i = 0; i < n; i++) g->set(i, fn(elements[i]));
+    return g;
+}
+
 /** Runtime stack
  *
  * This class encapsulates a single control stack. Activation records are
@@ -144,38 +1481,306 @@ public:
     // -- Global boolean to make sure adel functions are called correctly
     static bool safeCall;
 
+    // -- List of all runtimes, so that we can find the next deadline
+    static AdelRuntime * first;
+
+    // -- Called by adel_idle to sleep for the given number of milliseconds
+    static void (*sleepfn)(uint32_t ms);
+
 private:
     // -- Root of this tree of activation records
     AdelAR * root;
 
+    // -- Set when the last pass finished the function but it has not been
+    //    restarted (see aonce and aevery)
+    bool finished;
+
+    // -- Number of periods that aevery started late or dropped
+    uint16_t late;
+
+#ifdef ADEL_MEMSTATS
+    // -- The ARs allocated while this runtime was running
+    AdelMemStats mem;
+#endif
+
+    // -- Memory of the last root AR, kept for the next run (see reset)
+    void * spare;
+    uint16_t sparesize;
+
+    AdelRuntime * next;
+
 public:
     AdelRuntime()
-        : root(0)
-        {}
+        : root(0),
+          finished(false),
+          late(0),
+          spare(0),
+          sparesize(0),
+          next(first)
+    {
+        first = this;
+    }
+
+    // -- Delete the function that is still running, if any, and take
+    //    the runtime off the list, so that a runtime does not have to
+    //    live forever (the ones made by arepeat and friends do)
+    ~AdelRuntime() {
+        if (root) delete root;
+        if (spare) AdelAR::release(spare, sparesize);
+        AdelRuntime ** pos = & first;
+        while (*pos != this) pos = & (*pos)->next;
+        *pos = next;
+    }
 
     // -- A null root signals that the function is not running
     inline bool not_running() const { return root == 0; }
 
     // -- Initialize a new run
-    inline void init(AdelAR * ar) { root = ar; }
+    inline void init(AdelAR * ar) {
+        root = ar;
+        finished = false;
+    }
 
     // -- Run a single pass over the tree. This function is executed many,
     //    many times as the functions make progress.
-    inline astatus run() { return root->run(); }
+    inline astatus run() { return run(adel_millis()); }
+
+    // -- The same, with the clock already read by the caller
+    inline astatus run(uint32_t now) {
+        adel_now = now;
+        astatus s = root->step();
+        finished = s.done();
+        return s;
+    }
+
+    // -- Put the whole tree to sleep until time t (see aevery)
+    inline void sleep(uint32_t t) { root->sleep(t); }
+
+    // -- The function finished a periodic run: should it start again now?
+    //    (see adel_period)
+    inline bool period(uint32_t & nexttime, uint32_t T, uint8_t policy) {
+        return adel_period(adel_now, nexttime, T, policy, late);
+    }
+
+    inline uint16_t overruns() const { return late; }
+
+#ifdef ADEL_MEMSTATS
+    inline const AdelMemStats & memory() const { return mem; }
+    inline AdelMemStats & memory() { return mem; }
+#endif
 
-    // -- Reset the run, deleting all activation records
+    // -- Does the function need a pass? True if it is not running yet.
+    inline bool ready() const { return ! root || root->ready(); }
+
+    // -- Reset the run, deleting all activation records. The root's
+    //    memory is kept for the next run, which is almost always the same
+    //    function again, so it has the same size.
     inline void reset() {
         if (root) {
+            if (spare) AdelAR::release(spare, sparesize);
+            AdelAR::retiring() = root;
             delete root;
+            spare = root;
+            sparesize = AdelAR::retiredsize();
             root = 0;
         }
+        finished = false;
+    }
+
+    // -- Hand out the kept memory for an AR of size sz, if it fits exactly
+    inline void * takespare(size_t sz) {
+        if ( ! spare || sz != sparesize) return 0;
+        void * p = spare;
+        spare = 0;
+        return p;
+    }
+
+    // -- If every runtime is asleep, call sleepfn for the time remaining
+    //    until the earliest one wakes up, or ADEL_FOREVER if they are all
+    //    waiting for events. A runtime that finished and will never be
+    //    restarted (aonce) does not count. A runtime that is awake, or
+    //    about to restart its function, means there is no time to sleep at
+    //    all.
+    static void idle() {
+        if ( ! sleepfn) return;
+        uint16_t ep = AdelEvent::current();
+        uint8_t how = 0;
+        uint32_t t = 0;
+        for (AdelRuntime * r = first; r; r = r->next) {
+            if ( ! r->root) return;
+            if ( ! r->root->asleep()) {
+                if (r->finished) continue;
+                return;
+            }
+            if ( ! AdelAR::parked(r->root, astatus::ACONT, ep, how, t)) return;
+        }
+        if ( ! (how & ADEL_TIMED)) {
+            if (how) sleepfn(ADEL_FOREVER);
+            return;
+        }
+        uint32_t now = adel_millis();
+        if (adel_before(now, t)) sleepfn(t - now);
+    }
+
+#ifdef ADEL_MEMSTATS
+    // -- See adel_memory_dump
+    static void memorydump() {
+        Serial.println("what,name,size,live,bytes,peak_live,peak_bytes");
+        for (AdelMemFunction * f = AdelMemFunction::first(); f; f = f->next) {
+            Serial.print("function,");
+            Serial.print(f->name);
+            Serial.print(",");
+            Serial.print(f->size);
+            f->print();
+        }
+        uint8_t i = 0;
+        for (AdelRuntime * r = first; r; r = r->next) {
+            Serial.print("runtime,");
+            Serial.print(i++);
+            Serial.print(",");
+            r->mem.print();
+        }
+        Serial.print("total,,");
+        AdelMemStats::total().print();
+    }
+#endif
+};
+
+/** adel_idle
+ *
+ *  Call at the end of loop() to let the processor sleep while every Adel
+ *  function is waiting in adelay. Does nothing unless a sleep function has
+ *  been installed in AdelRuntime::sleepfn.
+ */
+inline void adel_idle() { AdelRuntime::idle(); }
+
+inline void * adel_spare(size_t sz)
+{
+    return AdelRuntime::curStack ? AdelRuntime::curStack->takespare(sz) : 0;
+}
+
+#ifdef ADEL_MEMSTATS
+inline AdelMemStats * adel_memowner()
+{
+    return AdelRuntime::curStack ? & AdelRuntime::curStack->memory() : 0;
+}
+
+/** adel_memory_dump
+ *
+ *  Print the memory statistics over Serial as CSV: one row per Adel
+ *  function that has run, with the size of its AR, one row per runtime
+ *  (most recently started first), and the total.
+ */
+inline void adel_memory_dump() { AdelRuntime::memorydump(); }
+#endif
+
+/** Prioritized runtime
+ *
+ * A runtime created by arepeat_at or aevery_at. It does not run where it
+ * is declared: it joins a list sorted by priority (highest first, equal
+ * priorities in the order they were declared), and adel_dispatch gives it
+ * its passes. The function is started through a plain function pointer,
+ * so that the dispatcher can restart it from anywhere.
+ */
+class AdelPrioRuntime : public AdelRuntime
+{
+public:
+    typedef AdelAR * (*Start)();
+
+    // -- List of prioritized runtimes, highest priority first
+    static AdelPrioRuntime * firstprio;
+
+private:
+    Start start;
+
+    // -- Period and policy for aevery_at; a zero period means arepeat_at
+    uint32_t T;
+    uint32_t nexttime;
+    uint8_t policy;
+
+    uint8_t prio;
+    AdelPrioRuntime * nextprio;
+
+public:
+    AdelPrioRuntime(uint8_t p, Start s, uint32_t period = 0,
+                    uint8_t pol = ADEL_EVERY_POLICY)
+        : start(s),
+          T(period),
+          nexttime(adel_millis() + period),
+          policy(pol),
+          prio(p)
+    {
+        AdelPrioRuntime ** pos = & firstprio;
+        while (*pos && (*pos)->prio >= p) pos = & (*pos)->nextprio;
+        nextprio = *pos;
+        *pos = this;
+    }
+
+    ~AdelPrioRuntime() {
+        AdelPrioRuntime ** pos = & firstprio;
+        while (*pos != this) pos = & (*pos)->nextprio;
+        *pos = nextprio;
+    }
+
+    // -- One pass, starting or restarting the function as needed
+    void pass(uint32_t now) {
+        curStack = this;
+        if (not_running()) {
+            safeCall = true;
+            init(start());
+        }
+        if ( ! run(now).done()) return;
+        if (T == 0) {
+            reset();
+        } else if (period(nexttime, T, policy)) {
+            reset();
+            safeCall = true;
+            init(start());
+            run(now);
+        } else
+            sleep(nexttime);
+    }
+
+    // -- Give the runtime a pass if it is ready at time now. Returns true
+    //    if it had one, in which case the clock has moved on.
+    inline bool poll(uint32_t now) {
+        adel_now = now;
+        if ( ! ready()) return false;
+        pass(now);
+        return true;
+    }
+
+    // -- Visit every runtime once, in priority order. Before each one, the
+    //    runtimes with a higher priority get another pass if they have
+    //    become ready in the meantime. A pass is never interrupted, so the
+    //    latency of a high-priority function is at most one pass of its
+    //    slowest lower-priority neighbour, rather than one pass of all of
+    //    them. The clock is read again only after a pass, since nothing
+    //    else takes any time, so a deadline that falls during one pass is
+    //    seen before the next.
+    static void dispatch() {
+        uint32_t now = adel_millis();
+        for (AdelPrioRuntime * r = firstprio; r; r = r->nextprio) {
+            for (AdelPrioRuntime * h = firstprio; h != r && h->prio > r->prio; h = h->nextprio)
+                if (h->poll(now)) now = adel_millis();
+            if (r->poll(now)) now = adel_millis();
+        }
     }
 };
 
+/** adel_dispatch
+ *
+ *  Call in loop() to run the functions started with arepeat_at and
+ *  aevery_at, in priority order.
+ */
+inline void adel_dispatch() { AdelPrioRuntime::dispatch(); }
+
 // ------------------------------------------------------------
 //   Internal macros
 
-#ifdef ADEL_DEBUG
+#if defined(ADEL_TRACE)
+#define adel_debug(m, line)  AdelTrace::record(a_ar, a_fun_name, m, line);
+#elif defined(ADEL_DEBUG)
 #define adel_debug(m, line)                     \
     Serial.print(m);                            \
     Serial.print(" in ");                       \
@@ -186,6 +1791,27 @@ public:
 #define adel_debug(m, line)  ;
 #endif
 
+// -- Find the profile entry once per function, and count the call. The
+//    body hands the entry to its AR on the first pass (see AdelProfile).
+#ifdef ADEL_PROFILE
+#define adel_profile_call                                               \
+    static AdelProfileEntry * const adel_prof = AdelProfile::slot(__FUNCTION__); \
+    if (adel_prof) adel_prof->calls++;
+#define adel_profile_start  a_ar->prof = adel_prof;
+#else
+#define adel_profile_call
+#define adel_profile_start
+#endif
+
+// -- Same for the memory statistics (see AdelMemFunction)
+#ifdef ADEL_MEMSTATS
+#define adel_memstats_call   static AdelMemFunction adel_mem(__FUNCTION__);
+#define adel_memstats_start  a_ar->account(& adel_mem);
+#else
+#define adel_memstats_call
+#define adel_memstats_start
+#endif
+
 /** gensym
  *
  *  These macros allow us to construct identifier names using line
@@ -205,6 +1831,13 @@ public:
 #define anextstep (__LINE__*10)
 #define alaterstep(offset) (__LINE__*10 + offset)
 
+/** adel_as
+ *
+ *  A null pointer with the static type of the Adel function call f, which
+ *  tells runchild how to call it. The call itself is not evaluated.
+ */
+#define adel_as(f) ((decltype(adel_artype(f))) 0)
+
 // ------------------------------------------------------------
 //   Top-level functions for use in Arduino loop()
 //
@@ -228,21 +1861,31 @@ public:
 
 /** aevery
  *  
- *  Run the given Adel function every T milliseconds.
+ *  Run the given Adel function every T milliseconds, starting right
+ *  away. If a run takes longer than T, the policy says what to do about
+ *  the periods it missed (see adel_period); aevery uses
+ *  ADEL_EVERY_POLICY. Right after the aevery, the number of periods that
+ *  were missed so far is AdelRuntime::curStack->overruns().
  */
-#define aevery( T, f )                                                  \
+#define aevery( T, f ) aevery_policy( T, ADEL_EVERY_POLICY, f )
+
+#define aevery_policy( T, policy, f )                                   \
     static AdelRuntime agensym(aruntime, __LINE__);                     \
     AdelRuntime::curStack = & agensym(aruntime, __LINE__);              \
-    static uint32_t agensym(anexttime,__LINE__) = millis() + T;         \
+    static uint32_t agensym(anexttime,__LINE__) = adel_millis() + T;    \
     if ( AdelRuntime::curStack->not_running()) {                        \
         AdelRuntime::safeCall = true;                                   \
         AdelRuntime::curStack->init( f );                               \
     }                                                                   \
     astatus agensym(f_status, __LINE__) = AdelRuntime::curStack->run(); \
-    if (agensym(f_status, __LINE__).done() &&                           \
-        agensym(anexttime,__LINE__) < millis()) {                       \
-        AdelRuntime::curStack->reset();                                 \
-        agensym(anexttime,__LINE__) += T;                               \
+    if (agensym(f_status, __LINE__).done()) {                           \
+        if (AdelRuntime::curStack->period(agensym(anexttime,__LINE__), T, policy)) { \
+            AdelRuntime::curStack->reset();                             \
+            AdelRuntime::safeCall = true;                               \
+            AdelRuntime::curStack->init( f );                           \
+            AdelRuntime::curStack->run();                               \
+        } else                                                          \
+            AdelRuntime::curStack->sleep(agensym(anexttime,__LINE__));  \
     }
 
 /** aonce
@@ -254,12 +1897,30 @@ public:
 #define aonce( f )                                             \
     static AdelRuntime agensym(aruntime, __LINE__);            \
     AdelRuntime::curStack = & agensym(aruntime, __LINE__);     \
-    if (AdelRuntime::curStack->not_running())                  \
+    if (AdelRuntime::curStack->not_running()) {                \
         AdelRuntime::safeCall = true;                          \
         AdelRuntime::curStack->init( f );                      \
     }                                                          \
     AdelRuntime::curStack->run();
 
+/** arepeat_at and aevery_at
+ *
+ *  Like arepeat and aevery, but the function runs at the given priority
+ *  (0-255, higher runs first) under adel_dispatch instead of right here.
+ *  The call f is wrapped in a function without captures, so its arguments
+ *  cannot refer to local variables of loop(). These can also be declared
+ *  outside of any function.
+ */
+#define arepeat_at( p, f )                                              \
+    static AdelPrioRuntime agensym(aruntime, __LINE__)( p,              \
+        []() -> AdelAR * { return f; });
+
+#define aevery_at( p, T, f ) aevery_policy_at( p, T, ADEL_EVERY_POLICY, f )
+
+#define aevery_policy_at( p, T, policy, f )                             \
+    static AdelPrioRuntime agensym(aruntime, __LINE__)( p,              \
+        []() -> AdelAR * { return f; }, T, policy);
+
 // ------------------------------------------------------------
 //   Function prologue and epilogue
 
@@ -278,8 +1939,40 @@ public:
  *  The definition of this macro ensures that users don't forget to
  *  call Adel functions inside a concurrency primitive, even if it
  *  is just "andthen".
+ *
+ *  With ADEL_STATIC, each Adel function returns its AdelMaker by value
+ *  instead of a plain AdelAR *, so that the constructs in its callers
+ *  know exactly which lambda they are running (see adel_as) and call it
+ *  directly. A function must then be defined before it is called, and it
+ *  cannot call itself.
  */
+#ifdef ADEL_STATIC
+static_assert(__cplusplus >= 201402L,
+              "ADEL_STATIC needs C++14 (-std=gnu++14) for its auto return types");
+#define adel auto __attribute__((warn_unused_result))
+#else
 #define adel AdelAR * __attribute__((warn_unused_result)) 
+#endif
+
+/** adel_checkcall
+ *
+ *  Runtime detection of calls to adel functions outside of a construct.
+ *  With ADEL_STATIC the function has nothing to return yet at this
+ *  point, so it reports the call and carries on; the caller throws the
+ *  result away (which the compiler also warns about), so nothing runs.
+ */
+#ifdef ADEL_STATIC
+#define adel_ignorecall
+#else
+#define adel_ignorecall  return 0;
+#endif
+
+#define adel_checkcall                                                  \
+    if ( ! AdelRuntime::safeCall) {                                     \
+        Serial.print("ERROR: Ignoring unsafe call to adel function ");  \
+        Serial.println(a_fun_name);                                     \
+        adel_ignorecall                                                 \
+    }
 
 /** abegin
  *
@@ -295,11 +1988,9 @@ public:
  */
 #define abegin                                                          \
     const char * a_fun_name = __FUNCTION__;                             \
-    if ( ! AdelRuntime::safeCall) {                                     \
-        Serial.print("ERROR: Ignoring unsafe call to adel function ");  \
-        Serial.println(a_fun_name);                                     \
-        return 0;                                                       \
-    }                                                                   \
+    adel_checkcall;                                                     \
+    adel_profile_call;                                                  \
+    adel_memstats_call;                                                 \
     /* -- These variables become persistent state in the closure */     \
     uint16_t adel_pc = 0;                                               \
     uint32_t adel_wait = 0;                                             \
@@ -307,24 +1998,33 @@ public:
     /* ----- Start the lambda -- the body of the function ----- */      \
     auto adel_body = [=](AdelAR * a_ar) mutable {                       \
         astatus f_status, g_status, h_status;                           \
-        if (adel_pc == 0) { adel_debug("abegin", __LINE__);}            \
+        if (a_ar->stopping()) {                                         \
+            if (adel_pc == 0 || adel_pc == ADEL_FINALLY)                \
+                return astatus::ADONE;                                  \
+            adel_pc = ADEL_CLEANUP;                                     \
+        }                                                               \
+        if (adel_pc == 0) {                                             \
+            adel_debug("abegin", __LINE__);                             \
+            adel_profile_start;                                         \
+            adel_memstats_start;                                        \
+        }                                                               \
         switch (adel_pc) {                                              \
         case 0
 
 /** aend
  *
  *  Create and return a local activation record with the new lambda
- *  embedded in it.
+ *  embedded in it (see AdelMaker).
  */
 #define aend                                                           \
+        adel_debug("aend", __LINE__);                                  \
         case ADEL_FINALLY: ;                                           \
         }                                                              \
-        adel_debug("aend", __LINE__);                                  \
         adel_pc = ADEL_FINALLY;                                        \
         return astatus::ADONE;                                         \
     };                                                                 \
     /* -- Make and return the new AR */                                \
-    return new LocalAdelAR<decltype(adel_body)>(adel_body);
+    return adel_make(adel_body);
 
 // ------------------------------------------------------------
 //   General Adel functions
@@ -335,10 +2035,162 @@ public:
  */
 #define adelay(t)                                           \
     adel_pc = anextstep;                                    \
-    adel_wait = millis() + t;                               \
+    adel_wait = adel_now + t;                               \
     adel_debug("adelay", __LINE__);                         \
 case anextstep:                                             \
-    if (millis() < adel_wait) return astatus::ACONT;
+    if (adel_before(adel_now, adel_wait)) {                 \
+        a_ar->sleep(adel_wait);                             \
+        return astatus::ACONT;                              \
+    }
+
+/** await_event
+ *
+ *  Wait for an AdelEvent to be signalled. While waiting, the function is
+ *  not run at all, so there is no cost to waiting for a long time.
+ *  Example use:
+ *
+ *     AdelEvent button_pressed;   // signalled by an interrupt handler
+ *     ...
+ *     await_event( button_pressed );
+ */
+#define await_event( e )                                    \
+    adel_pc = anextstep;                                    \
+    adel_debug("await_event", __LINE__);                    \
+case anextstep:                                             \
+    {                                                       \
+        uint16_t ep = AdelEvent::current();                 \
+        if ( ! (e).take()) {                                \
+            a_ar->block(ep);                                \
+            return astatus::ACONT;                          \
+        }                                                   \
+    }
+
+/** asend
+ *
+ *  Semantics: put v into AdelChannel ch, waiting while it is full. The
+ *  function is parked while it waits, as in await_event.
+ */
+#define asend( ch, v )                                      \
+    adel_pc = anextstep;                                    \
+    adel_debug("asend", __LINE__);                          \
+case anextstep:                                             \
+    {                                                       \
+        uint16_t ep = AdelEvent::current();                 \
+        if ( ! (ch).put(v)) {                               \
+            a_ar->block(ep);                                \
+            return astatus::ACONT;                          \
+        }                                                   \
+    }
+
+/** areceive
+ *
+ *  Semantics: take the next value out of AdelChannel ch and store it in
+ *  v, waiting while the channel is empty. Example use:
+ *
+ *     AdelChannel<int, 16> samples;   // filled by an interrupt handler
+ *     ...
+ *     areceive( samples, value );
+ */
+#define areceive( ch, v )                                   \
+    adel_pc = anextstep;                                    \
+    adel_debug("areceive", __LINE__);                       \
+case anextstep:                                             \
+    {                                                       \
+        uint16_t ep = AdelEvent::current();                 \
+        if ( ! (ch).get(v)) {                               \
+            a_ar->block(ep);                                \
+            return astatus::ACONT;                          \
+        }                                                   \
+    }
+
+/** aput and aget
+ *
+ *  Semantics: put v at the end of AdelQueue q, or take the value at the
+ *  front of q and store it in v, waiting while the queue is full or
+ *  empty. These are the same as asend and areceive.
+ *
+ *     AdelQueue<int, 4> readings;
+ *     ...
+ *     aput( readings, analogRead(pin) );    // in one function
+ *     aget( readings, value );              // in another
+ */
+#define aput( q, v ) asend( q, v )
+#define aget( q, v ) areceive( q, v )
+
+/** aacquire and arelease
+ *
+ *  Semantics: wait for a permit from AdelSemaphore (or AdelMutex) s, and
+ *  give it back. Everything in between runs while holding the permit,
+ *  even across adelay and the other constructs:
+ *
+ *     AdelMutex bus;
+ *     ...
+ *     aacquire( bus );
+ *     Serial.print("temperature: ");
+ *     andthen( readtemp() );
+ *     Serial.println(temp);
+ *     arelease( bus );
+ *
+ *  The permit belongs to the function that took it: a function that
+ *  ends while it holds one (because auntil stopped it, for example) gives
+ *  it back, so it is best to give it back from the same function.
+ */
+#define aacquire( s )                                       \
+    adel_pc = anextstep;                                    \
+    adel_debug("aacquire", __LINE__);                       \
+case anextstep:                                             \
+    if ( ! (s).acquire(a_ar)) {                             \
+        if ((s).queued(a_ar)) a_ar->hold();                 \
+        return astatus::ACONT;                              \
+    }
+
+#define arelease( s )                                       \
+    adel_debug("arelease", __LINE__);                       \
+    (s).release(a_ar);
+
+/** adelay_us
+ *
+ *  Semantics: delay this function for t microseconds. For short periods,
+ *  like stepping a motor or bit-banging a protocol. Unlike adelay, the
+ *  function does not go to sleep, since checking the clock is cheaper
+ *  than the bookkeeping at these time scales.
+ */
+#define adelay_us(t)                                        \
+    adel_pc = anextstep;                                    \
+    adel_wait = adel_micros() + t;                          \
+    adel_debug("adelay_us", __LINE__);                      \
+case anextstep:                                             \
+    if (adel_before(adel_micros(), adel_wait)) return astatus::ACONT;
+
+/** adelay_until_us
+ *
+ *  Semantics: delay this function until micros() reaches time t. For
+ *  work that has to keep a steady rate, count each deadline from the
+ *  last one rather than from when the function woke up, so that being
+ *  late once does not push back every period after it:
+ *
+ *     adel stepper()
+ *     {
+ *       uint32_t next;
+ *       abegin:
+ *       next = micros();
+ *       while (1) {
+ *         next += 100;
+ *         adelay_until_us( next );
+ *         step();
+ *       }
+ *       aend;
+ *     }
+ *
+ *  Like every local that has to keep its value across a wait, next is
+ *  declared above abegin.
+ */
+#define adelay_until_us(t)                                  \
+    adel_pc = anextstep;                                    \
+    adel_wait = t;                                          \
+    adel_debug("adelay_until_us", __LINE__);                \
+case anextstep:                                             \
+    if (adel_before(adel_micros(), adel_wait)) return astatus::ACONT;
 
 /** andthen or acall
  *
@@ -353,8 +2205,11 @@ case anextstep:                                             \
     a_ar->init(0, f );                                      \
     adel_debug("andthen", __LINE__);                        \
 case anextstep:                                             \
-    f_status = a_ar->runchild(0);                           \
-    if ( f_status.notdone() ) return astatus::ACONT;        \
+    f_status = a_ar->runchild(0, adel_as(f));               \
+    if ( f_status.notdone() ) {                             \
+        a_ar->waitchildren(f_status);                       \
+        return astatus::ACONT;                              \
+    }                                                       \
     a_ar->clear(0);
 
 #define acall(f) andthen(f)
@@ -388,12 +2243,15 @@ case anextstep:                                 \
     adel_pc = anextstep;                              \
     AdelRuntime::safeCall = true;                     \
     a_ar->init(0, f );                                \
-    adel_wait = millis() + t;                         \
+    adel_wait = adel_now + t;                         \
     adel_debug("aforatmost", __LINE__);               \
 case anextstep:                                       \
-    f_status = a_ar->runchild(0);                     \
-    if (f_status.notdone() && millis() < adel_wait)   \
+    f_status = a_ar->runchild(0, adel_as(f));         \
+    if (f_status.notdone() && adel_before(adel_now, adel_wait)) { \
+        a_ar->waitchildren(f_status);                 \
+        a_ar->wakeby(adel_wait);                      \
         return astatus::ACONT;                        \
+    }                                                 \
     a_ar->clear(0);                                   \
     if (f_status.done()) adel_pc = alaterstep(1);     \
     else                 adel_pc = alaterstep(2);     \
@@ -401,6 +2259,29 @@ case alaterstep(1):                                   \
 case alaterstep(2):                                   \
     if ( adel_pc != alaterstep(1) )
     
+/** aforatmost_us
+ *
+ *  Semantics: same as aforatmost, but the timeout is t microseconds.
+ *  The caller stays awake while it waits, so that it can check the
+ *  timeout on every pass.
+ */
+#define aforatmost_us( t, f )                                 \
+    adel_pc = anextstep;                                      \
+    AdelRuntime::safeCall = true;                             \
+    a_ar->init(0, f );                                        \
+    adel_wait = adel_micros() + t;                            \
+    adel_debug("aforatmost_us", __LINE__);                    \
+case anextstep:                                               \
+    f_status = a_ar->runchild(0, adel_as(f));                 \
+    if (f_status.notdone() && adel_before(adel_micros(), adel_wait)) \
+        return astatus::ACONT;                                \
+    a_ar->clear(0);                                           \
+    if (f_status.done()) adel_pc = alaterstep(1);             \
+    else                 adel_pc = alaterstep(2);             \
+case alaterstep(1):                                           \
+case alaterstep(2):                                           \
+    if ( adel_pc != alaterstep(1) )
+
 /** aboth
  *
  *  Semantics: execute f and g asynchronously, until *both* are done
@@ -415,10 +2296,12 @@ case alaterstep(2):                                   \
     a_ar->init(1, g );                                \
     adel_debug("aboth", __LINE__);                    \
 case anextstep:                                       \
-    f_status = a_ar->runchild(0);                     \
-    g_status = a_ar->runchild(1);                     \
-    if (f_status.notdone() || g_status.notdone())     \
+    f_status = a_ar->runchild(0, adel_as(f));         \
+    g_status = a_ar->runchild(1, adel_as(g));         \
+    if (f_status.notdone() || g_status.notdone()) {   \
+        a_ar->waitchildren(f_status, g_status);       \
         return astatus::ACONT;                        \
+    }                                                 \
     a_ar->clear(0);                                   \
     a_ar->clear(1);
 
@@ -436,11 +2319,75 @@ case anextstep:                                       \
     a_ar->init(2, h );                                                  \
     adel_debug("athree", __LINE__);                                     \
 case anextstep:                                                         \
-    f_status = a_ar->runchild(0);                                       \
-    g_status = a_ar->runchild(1);                                       \
-    h_status = a_ar->runchild(2);                                       \
-    if (f_status.notdone() || g_status.notdone() || h_status.notdone()) \
-        return astatus::ACONT;
+    f_status = a_ar->runchild(0, adel_as(f));                           \
+    g_status = a_ar->runchild(1, adel_as(g));                           \
+    h_status = a_ar->runchild(2, adel_as(h));                           \
+    if (f_status.notdone() || g_status.notdone() || h_status.notdone()) { \
+        a_ar->waitchildren(f_status, g_status, h_status);               \
+        return astatus::ACONT;                                          \
+    }
+
+/** aall
+ *
+ *  Semantics: execute any number of functions asynchronously, until *all*
+ *  are done. Like aboth or athree, but for wider fan-out:
+ *      aall( readsensor(1), readsensor(2), readsensor(3), readsensor(4) );
+ */
+#define aall( ... )                                         \
+    adel_pc = anextstep;                                    \
+    AdelRuntime::safeCall = true;                           \
+    a_ar->init(0, adel_group(false, __VA_ARGS__) );         \
+    adel_debug("aall", __LINE__);                           \
+case anextstep:                                             \
+    f_status = a_ar->runchild(0);                           \
+    if ( f_status.notdone() ) {                             \
+        a_ar->waitchildren(f_status);                       \
+        return astatus::ACONT;                              \
+    }                                                       \
+    a_ar->clear(0);
+
+/** aforeach
+ *
+ *  Semantics: call fn on each of the first count elements of array, and
+ *  run all of the resulting functions asynchronously until *all* are
+ *  done. The array must be a real array (not a pointer), since its size
+ *  sets the size of the table that holds the running functions. It can
+ *  have up to 255 elements, and a count larger than that stops at the end
+ *  of the array:
+ *
+ *      int pins[16] = { ... };
+ *      aforeach( pins, numleds, blinker );
+ */
+#define aforeach( array, count, fn )                        \
+    adel_pc = anextstep;                                    \
+    AdelRuntime::safeCall = true;                           \
+    a_ar->init(0, adel_foreach(array, count, fn) );         \
+    adel_debug("aforeach", __LINE__);                       \
+case anextstep:                                             \
+    f_status = a_ar->runchild(0);                           \
+    if ( f_status.notdone() ) {                             \
+        a_ar->waitchildren(f_status);                       \
+        return astatus::ACONT;                              \
+    }                                                       \
+    a_ar->clear(0);
+
+/** aany
+ *
+ *  Semantics: execute any number of functions asynchronously, until *one*
+ *  of them is done. The others are stopped, as in auntil.
+ */
+#define aany( ... )                                         \
+    adel_pc = anextstep;                                    \
+    AdelRuntime::safeCall = true;                           \
+    a_ar->init(0, adel_group(true, __VA_ARGS__) );          \
+    adel_debug("aany", __LINE__);                           \
+case anextstep:                                             \
+    f_status = a_ar->runchild(0);                           \
+    if ( f_status.notdone() ) {                             \
+        a_ar->waitchildren(f_status);                       \
+        return astatus::ACONT;                              \
+    }                                                       \
+    a_ar->clear(0);
 
 /** auntil
  *
@@ -464,10 +2411,12 @@ case anextstep:                                                         \
     a_ar->init(1, g );                               \
     adel_debug("auntil", __LINE__);                  \
 case anextstep:                                      \
-    f_status = a_ar->runchild(0);                    \
-    g_status = a_ar->runchild(1);                    \
-    if (f_status.notdone() && g_status.notdone())    \
+    f_status = a_ar->runchild(0, adel_as(f));        \
+    g_status = a_ar->runchild(1, adel_as(g));        \
+    if (f_status.notdone() && g_status.notdone()) {  \
+        a_ar->waitchildren(f_status, g_status);      \
         return astatus::ACONT;                       \
+    }                                                \
     a_ar->clear(0);                                  \
     a_ar->clear(1);                                  \
     if (f_status.done()) adel_pc = alaterstep(1);    \
@@ -493,11 +2442,10 @@ case alaterstep(2):                                  \
  */
 #define aramp( T, v, start, end)                                        \
     adel_pc = anextstep;                                                \
-    adel_ramp_start = millis();                                         \
+    adel_ramp_start = adel_now;                                         \
     adel_debug("aramp", __LINE__);                                      \
 case anextstep:                                                         \
-    while ((millis() <= (adel_ramp_start + T)) &&                                         \
-          ((v = map(millis(), adel_ramp_start, adel_ramp_start + T, start, end)) == v) && \
+    while (adel_ramp(adel_ramp_start, T, start, end, v) &&              \
            (adel_pc = anextstep)) // Yes, this is an assignment, to make sure we loop
 
 /** alternate
@@ -515,16 +2463,22 @@ case anextstep:                                                         \
     a_ar->init(1, g );                              \
     adel_debug("alternate", __LINE__);              \
 case alaterstep(0):                                 \
-    f_status = a_ar->runchild(0);                   \
-    if (f_status.cont()) return astatus::ACONT;     \
+    f_status = a_ar->runchild(0, adel_as(f));       \
+    if (f_status.cont()) {                          \
+        a_ar->waitchildren(f_status);               \
+        return astatus::ACONT;                      \
+    }                                               \
     if (f_status.yield()) {                         \
         adel_pc = alaterstep(1);                    \
         return astatus::ACONT;                      \
     } else                                          \
         adel_pc = alaterstep(2);                    \
 case alaterstep(1):                                 \
-    g_status = a_ar->runchild(1);                   \
-    if (g_status.cont()) return astatus::ACONT;     \
+    g_status = a_ar->runchild(1, adel_as(g));       \
+    if (g_status.cont()) {                          \
+        a_ar->waitchildren(astatus::ADONE, g_status); \
+        return astatus::ACONT;                      \
+    }                                               \
     if (g_status.yield()) {                         \
         adel_pc = alaterstep(0);                    \
         return astatus::ACONT;                      \
@@ -542,14 +2496,87 @@ case alaterstep(2):
     return astatus::AYIELD;                         \
 case anextstep: ;
 
+/** areturn
+ *
+ *  Semantics: leave the function, like afinish, handing v back to the
+ *  caller. The function must be declared to return adel_of<T>, and v is
+ *  converted to T as if by a cast. v must be a number (see adel_carrier):
+ *
+ *     adel_of<int> readsensor(int pin)
+ *     {
+ *       int v;
+ *       abegin:
+ *       adelay(10);
+ *       v = analogRead(pin);
+ *       areturn( v );
+ *       aend;
+ *     }
+ */
+#define areturn( v )                                                    \
+    a_ar->setresult((adel_carrier<decltype((v) + 0)>::type) (v));       \
+    adel_pc = ADEL_CLEANUP;                                             \
+    adel_debug("areturn", __LINE__);                                    \
+    return astatus::ACONT;
+
+/** andthen_get
+ *
+ *  Semantics: run f to completion, like andthen, and then store the value
+ *  it returned in x. f must return adel_of<T>; if it finishes without
+ *  areturn, x gets T's default value. Example use:
+ *
+ *     andthen_get( level, readsensor(A0) );
+ */
+#define andthen_get( x, f )                                 \
+    adel_pc = anextstep;                                    \
+    AdelRuntime::safeCall = true;                           \
+    a_ar->init(0, f );                                      \
+    adel_debug("andthen_get", __LINE__);                    \
+case anextstep:                                             \
+    f_status = a_ar->runchild(0, adel_as(f));               \
+    if ( f_status.notdone() ) {                             \
+        a_ar->waitchildren(f_status);                       \
+        return astatus::ACONT;                              \
+    }                                                       \
+    x = * (decltype(f)::type *) a_ar->childresult(0);       \
+    a_ar->clear(0);
+
 /** afinish
  * 
  *  Semantics: leave the function immediately, and communicate to the
  *  caller that it is done.
  */
 #define afinish                                 \
-    adel_pc = ADEL_FINALLY;                     \
+    adel_pc = ADEL_CLEANUP;                     \
     adel_debug("afinish", __LINE__);            \
     return astatus::ACONT;
 
+/** afinally
+ *
+ *  Cleanup code that runs exactly once, whether the function reaches the
+ *  end, leaves with afinish or areturn, or is stopped by its caller (by
+ *  auntil, aforatmost, or aany, for example). It must come last, just
+ *  before aend:
+ *
+ *     adel blink(int pin)
+ *     {
+ *       abegin:
+ *       while (1) {
+ *         ...
+ *       }
+ *       afinally {
+ *         digitalWrite(pin, LOW);
+ *       }
+ *       aend;
+ *     }
+ *
+ *  When a function is stopped, its callees are cleaned up first. The
+ *  block runs all at once, so it must not contain adelay or any of the
+ *  other constructs.
+ */
+#define afinally                                \
+case ADEL_CLEANUP:                              \
+    adel_debug("afinally", __LINE__);
+
+#endif // ADEL_COROUTINES
+
 #endif
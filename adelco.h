@@ -0,0 +1,478 @@
+/***********************************************************************
+ *
+ * Adel Microcontroller Concurrency Library -- coroutine backend
+ *
+ * (c) 2017 Samuel Z. Guyer
+ *
+ * Included by adel.h when ADEL_COROUTINES is defined. Do not include it
+ * directly.
+ *
+ * github.com/samguyer/adel
+ *
+ ***********************************************************************/
+
+#include <coroutine>
+#include <exception>
+
+/** AdelTask
+ *
+ *  With ADEL_COROUTINES, each Adel function is a C++20 coroutine, and
+ *  AdelTask is the handle that its caller holds. The constructs are built
+ *  on co_await instead of a switch on __LINE__, so the compiler sees the
+ *  whole function at once, and user code can use switch and break freely.
+ *  Every local variable lives in the coroutine frame, not just the ones
+ *  declared above abegin.
+ *
+ *  Frames are allocated from the AdelPool arena. The compiler knows the
+ *  size of each frame, and framesize() reports it, so that you can budget
+ *  ADEL_POOL_BYTES for the functions that run at the same time.
+ *
+ *  The promise holds the same sleep state as AdelAR in the default
+ *  backend (see AdelSleep), so a caller skips a function that is waiting
+ *  in adelay or await_event without resuming it.
+ */
+class [[nodiscard]] AdelTask
+{
+public:
+    struct promise_type : public AdelSleep
+    {
+        // -- Set by ayourturn, so that the caller sees AYIELD
+        bool yielded;
+
+        // -- Size of the frame, including this promise
+        uint16_t size;
+
+#ifdef ADEL_PROFILE
+        // -- Where to add up the time spent in this function
+        AdelProfileEntry * prof;
+#endif
+
+        // -- The frame is allocated before the promise is constructed, so
+        //    operator new leaves the size here for the constructor
+        static size_t & lastsize() { static size_t s = 0; return s; }
+
+        promise_type()
+            : AdelSleep(),
+              yielded(false),
+              size(lastsize())
+            {
+#ifdef ADEL_PROFILE
+                prof = 0;
+#endif
+            }
+
+        AdelTask get_return_object() {
+            return AdelTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        // -- Start suspended, like a new AR, and stay suspended at the end
+        //    so that the caller can see that the function is done
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        // -- There is no caller to hand an exception to, since the caller
+        //    only sees the function as finished, so stop right there
+        void unhandled_exception() { std::terminate(); }
+
+        static void * operator new(size_t sz) {
+            lastsize() = sz;
+            return AdelPool::alloc(sz);
+        }
+        static void operator delete(void * p, size_t sz) { AdelPool::release(p, sz); }
+    };
+
+    typedef std::coroutine_handle<promise_type> handle;
+
+    /** Awaiters
+     *
+     *  Every construct suspends the function with one of these, telling
+     *  the caller what it is waiting for: nothing (run again on the next
+     *  pass), a time, an event epoch, or to let the other side of an
+     *  alternate run.
+     */
+    struct pass
+    {
+        uint8_t how;
+        uint32_t t;
+        uint16_t ep;
+        bool yield;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(handle h) const noexcept {
+            promise_type & p = h.promise();
+            p.sleeping = how;
+            p.wake = t;
+            p.epoch = ep;
+            p.yielded = yield;
+        }
+        void await_resume() const noexcept {}
+
+        // -- Wake up no later than time t (see aforatmost)
+        pass by(uint32_t deadline) const {
+            pass w = *this;
+            if (w.how && ( ! (w.how & ADEL_TIMED) || adel_before(deadline, w.t))) w.t = deadline;
+            if (w.how) w.how |= ADEL_TIMED;
+            return w;
+        }
+    };
+
+    static pass next() { return pass{ 0, 0, 0, false }; }
+    static pass until(uint32_t t) { return pass{ ADEL_TIMED, t, 0, false }; }
+    static pass blocked(uint16_t ep) { return pass{ ADEL_BLOCKED, 0, ep, false }; }
+    static pass yourturn() { return pass{ 0, 0, 0, true }; }
+    static pass held() { return pass{ ADEL_QUEUED, 0, 0, false }; }
+
+    // -- The function that is running, which is the parent of any function
+    //    it steps (see AdelSleep)
+    static promise_type *& running() { static promise_type * p = 0; return p; }
+
+private:
+    handle h;
+
+public:
+    AdelTask() : h(nullptr) {}
+    explicit AdelTask(handle hh) : h(hh) {}
+    AdelTask(AdelTask && other) : h(other.h) { other.h = nullptr; }
+    AdelTask(const AdelTask &) = delete;
+
+    AdelTask & operator=(AdelTask && other) {
+        if (this != &other) {
+            clear();
+            h = other.h;
+            other.h = nullptr;
+        }
+        return *this;
+    }
+
+    ~AdelTask() { clear(); }
+
+    inline bool empty() const { return ! h; }
+
+    // -- Destroy the frame, which also destroys the frames of any
+    //    functions it is waiting for
+    inline void clear() {
+        if (h) {
+#ifdef ADEL_TRACE
+            AdelTrace::record(h.address(), 0, "free", 0);
+#endif
+            h.destroy();
+            h = nullptr;
+        }
+    }
+
+    // -- Size of the coroutine frame, in bytes
+    inline uint16_t framesize() const { return h ? h.promise().size : 0; }
+
+    // -- Does this function need to run on this pass? (see AdelAR::ready)
+    inline bool ready() const {
+        const promise_type & p = h.promise();
+        if ( ! p.sleeping) return true;
+        if ((p.sleeping & ADEL_BLOCKED) && p.epoch != AdelEvent::current()) return true;
+        if ((p.sleeping & ADEL_TIMED) && ! adel_before(adel_now, p.wake)) return true;
+        return false;
+    }
+
+    // -- Resume the function up to its next suspension, unless it is
+    //    asleep or already done
+    inline astatus step() {
+        if (h.done()) return astatus::ADONE;
+        promise_type & p = h.promise();
+        if (p.sleeping) {
+            if ( ! ready()) return astatus::ACONT;
+            p.sleeping = 0;
+        }
+        p.yielded = false;
+        promise_type * parent = running();
+        p.parent = parent;
+        running() = &p;
+#ifdef ADEL_TRACE
+        const void * caller = AdelTrace::current();
+        AdelTrace::current() = h.address();
+        AdelTrace::record(h.address(), 0, "resume", 0);
+#endif
+#ifdef ADEL_PROFILE
+        // -- The body names its profile entry in abegin, on the first pass
+        AdelProfileEntry * outer = AdelProfile::started();
+        AdelProfile::started() = 0;
+        AdelProfile::pass m;
+#endif
+        h.resume();
+        running() = parent;
+#ifdef ADEL_PROFILE
+        if ( ! p.prof) p.prof = AdelProfile::started();
+        m.done(p.prof);
+        AdelProfile::started() = outer;
+#endif
+#ifdef ADEL_TRACE
+        AdelTrace::record(h.address(), 0, "suspend", 0);
+        AdelTrace::current() = caller;
+#endif
+        if (h.done()) return astatus::ADONE;
+        return p.yielded ? astatus::AYIELD : astatus::ACONT;
+    }
+
+    // -- Called when a construct is still waiting for n children. Returns
+    //    the awaiter that puts this function to sleep until the earliest
+    //    of them wakes up, or just until the next pass if any of them
+    //    needs polling (see AdelAR::waitchildren).
+    static pass waitchildren(const AdelTask * ch, const astatus * s, int n) {
+        uint16_t ep = AdelEvent::current();
+        uint8_t how = 0;
+        uint32_t t = 0;
+        for (int i = 0; i < n; i++) {
+            if ( ! s[i].notdone()) continue;
+            if ( ! s[i].cont()) return next();
+            const promise_type & p = ch[i].h.promise();
+            if ( ! p.sleeping) return next();
+            if ((p.sleeping & ADEL_BLOCKED) && p.epoch != ep) return next();
+            if (p.sleeping & ADEL_TIMED) {
+                if ( ! (how & ADEL_TIMED) || adel_before(p.wake, t)) t = p.wake;
+            }
+            how |= p.sleeping;
+        }
+        return pass{ how, t, ep, false };
+    }
+};
+
+// ------------------------------------------------------------
+//   Internal macros
+
+#if defined(ADEL_TRACE)
+#define adel_debug(m, line)                                             \
+    AdelTrace::record(AdelTrace::current(), a_fun_name, m, line);
+#elif defined(ADEL_DEBUG)
+#define adel_debug(m, line)                     \
+    Serial.print(m);                            \
+    Serial.print(" in ");                       \
+    Serial.print(a_fun_name);                   \
+    Serial.print(":");                          \
+    Serial.println(line)
+#else
+#define adel_debug(m, line)  ;
+#endif
+
+#ifdef ADEL_PROFILE
+#define adel_profile_call                                               \
+    static AdelProfileEntry * const adel_prof = AdelProfile::slot(__FUNCTION__); \
+    if (adel_prof) adel_prof->calls++;                                  \
+    AdelProfile::started() = adel_prof;
+#else
+#define adel_profile_call
+#endif
+
+#define agensym2(a,b) a##b
+#define agensym(a,b) agensym2(a,b)
+
+// ------------------------------------------------------------
+//   Top-level functions for use in Arduino loop()
+
+#define arepeat( f )                                                    \
+    static AdelTask agensym(atask, __LINE__);                           \
+    if (agensym(atask, __LINE__).empty())                               \
+        agensym(atask, __LINE__) = f;                                   \
+    adel_now = adel_millis();                                           \
+    if (agensym(atask, __LINE__).step().done())                         \
+        agensym(atask, __LINE__).clear();
+
+#define aevery( T, f ) aevery_policy( T, ADEL_EVERY_POLICY, f )
+
+#define aevery_policy( T, policy, f )                                   \
+    static AdelTask agensym(atask, __LINE__);                           \
+    static uint32_t agensym(anexttime,__LINE__) = adel_millis() + T;    \
+    static uint16_t agensym(aoverruns,__LINE__) = 0;                    \
+    if (agensym(atask, __LINE__).empty())                               \
+        agensym(atask, __LINE__) = f;                                   \
+    adel_now = adel_millis();                                           \
+    if (agensym(atask, __LINE__).step().done() &&                       \
+        adel_period(adel_now, agensym(anexttime,__LINE__), T, policy,   \
+                    agensym(aoverruns,__LINE__))) {                     \
+        agensym(atask, __LINE__) = f;                                   \
+        agensym(atask, __LINE__).step();                                \
+    }
+
+#define aonce( f )                                                      \
+    static AdelTask agensym(atask, __LINE__);                           \
+    static bool agensym(astarted, __LINE__) = false;                    \
+    if ( ! agensym(astarted, __LINE__)) {                               \
+        agensym(atask, __LINE__) = f;                                   \
+        agensym(astarted, __LINE__) = true;                             \
+    }                                                                   \
+    adel_now = adel_millis();                                           \
+    agensym(atask, __LINE__).step();
+
+// ------------------------------------------------------------
+//   Function prologue and epilogue
+
+#define adel AdelTask
+
+/** abegin
+ *
+ *  Declares the state that the constructs share: the callees that are
+ *  running (up to three, as in athree), their status on the last pass,
+ *  and the timers. The label is only there so that "abegin:" keeps
+ *  working; the goto keeps the compiler from warning that it is unused.
+ */
+#define abegin                                                          \
+    const char * a_fun_name = __FUNCTION__;                             \
+    AdelTask adel_c[3];                                                 \
+    astatus adel_s[3];                                                  \
+    uint32_t adel_wait = 0;                                             \
+    uint32_t adel_ramp_start = 0;                                       \
+    uint8_t adel_k = 0;                                                 \
+    uint16_t adel_ep = 0;                                               \
+    (void) a_fun_name;                                                  \
+    (void) adel_s;                                                      \
+    adel_profile_call;                                                  \
+    adel_debug("abegin", __LINE__);                                     \
+    if (false) goto adel_start;                                         \
+    adel_start
+
+#define aend                                                            \
+    adel_debug("aend", __LINE__);                                       \
+    co_return
+
+// ------------------------------------------------------------
+//   General Adel functions
+//
+//   Same semantics as the default backend; see adel.h.
+
+#define adelay(t)                                                       \
+    adel_wait = adel_now + t;                                           \
+    adel_debug("adelay", __LINE__);                                     \
+    while (adel_before(adel_now, adel_wait))                            \
+        co_await AdelTask::until(adel_wait);
+
+#define await_event( e )                                                \
+    adel_debug("await_event", __LINE__);                                \
+    while (adel_ep = AdelEvent::current(), ! (e).take())                \
+        co_await AdelTask::blocked(adel_ep);
+
+#define asend( ch, v )                                                  \
+    adel_debug("asend", __LINE__);                                      \
+    while (adel_ep = AdelEvent::current(), ! (ch).put(v))               \
+        co_await AdelTask::blocked(adel_ep);
+
+#define areceive( ch, v )                                               \
+    adel_debug("areceive", __LINE__);                                   \
+    while (adel_ep = AdelEvent::current(), ! (ch).get(v))               \
+        co_await AdelTask::blocked(adel_ep);
+
+#define aput( q, v ) asend( q, v )
+#define aget( q, v ) areceive( q, v )
+
+#define aacquire( s )                                                   \
+    adel_debug("aacquire", __LINE__);                                   \
+    while ( ! (s).acquire(AdelTask::running()))                         \
+        co_await ((s).queued(AdelTask::running()) ?                     \
+                  AdelTask::held() : AdelTask::next());
+
+#define arelease( s )                                                   \
+    adel_debug("arelease", __LINE__);                                   \
+    (s).release(AdelTask::running());
+
+#define adelay_us(t)                                                    \
+    adel_wait = adel_micros() + t;                                      \
+    adel_debug("adelay_us", __LINE__);                                  \
+    while (adel_before(adel_micros(), adel_wait))                       \
+        co_await AdelTask::next();
+
+#define adelay_until_us(t)                                              \
+    adel_wait = t;                                                      \
+    adel_debug("adelay_until_us", __LINE__);                            \
+    while (adel_before(adel_micros(), adel_wait))                       \
+        co_await AdelTask::next();
+
+#define andthen( f )                                                    \
+    adel_c[0] = f;                                                      \
+    adel_debug("andthen", __LINE__);                                    \
+    while ((adel_s[0] = adel_c[0].step()).notdone())                    \
+        co_await AdelTask::waitchildren(adel_c, adel_s, 1);             \
+    adel_c[0].clear();
+
+#define acall(f) andthen(f)
+
+#define await( c )                                                      \
+    adel_debug("await", __LINE__);                                      \
+    while ( ! ( c ) ) co_await AdelTask::next()
+
+#define aforatmost( t, f )                                              \
+    adel_c[0] = f;                                                      \
+    adel_wait = adel_now + t;                                           \
+    adel_debug("aforatmost", __LINE__);                                 \
+    while ((adel_s[0] = adel_c[0].step()).notdone() &&                  \
+           adel_before(adel_now, adel_wait))                            \
+        co_await AdelTask::waitchildren(adel_c, adel_s, 1).by(adel_wait); \
+    adel_c[0].clear();                                                  \
+    if ( ! adel_s[0].done())
+
+#define aforatmost_us( t, f )                                           \
+    adel_c[0] = f;                                                      \
+    adel_wait = adel_micros() + t;                                      \
+    adel_debug("aforatmost_us", __LINE__);                              \
+    while ((adel_s[0] = adel_c[0].step()).notdone() &&                  \
+           adel_before(adel_micros(), adel_wait))                       \
+        co_await AdelTask::next();                                      \
+    adel_c[0].clear();                                                  \
+    if ( ! adel_s[0].done())
+
+#define aboth( f , g )                                                  \
+    adel_c[0] = f;                                                      \
+    adel_c[1] = g;                                                      \
+    adel_debug("aboth", __LINE__);                                      \
+    while (adel_s[0] = adel_c[0].step(), adel_s[1] = adel_c[1].step(),  \
+           adel_s[0].notdone() || adel_s[1].notdone())                  \
+        co_await AdelTask::waitchildren(adel_c, adel_s, 2);             \
+    adel_c[0].clear();                                                  \
+    adel_c[1].clear();
+
+#define athree( f , g , h )                                             \
+    adel_c[0] = f;                                                      \
+    adel_c[1] = g;                                                      \
+    adel_c[2] = h;                                                      \
+    adel_debug("athree", __LINE__);                                     \
+    while (adel_s[0] = adel_c[0].step(), adel_s[1] = adel_c[1].step(),  \
+           adel_s[2] = adel_c[2].step(),                                \
+           adel_s[0].notdone() || adel_s[1].notdone() || adel_s[2].notdone()) \
+        co_await AdelTask::waitchildren(adel_c, adel_s, 3);             \
+    adel_c[0].clear();                                                  \
+    adel_c[1].clear();                                                  \
+    adel_c[2].clear();
+
+#define auntil( f , g )                                                 \
+    adel_c[0] = f;                                                      \
+    adel_c[1] = g;                                                      \
+    adel_debug("auntil", __LINE__);                                     \
+    while (adel_s[0] = adel_c[0].step(), adel_s[1] = adel_c[1].step(),  \
+           adel_s[0].notdone() && adel_s[1].notdone())                  \
+        co_await AdelTask::waitchildren(adel_c, adel_s, 2);             \
+    adel_c[0].clear();                                                  \
+    adel_c[1].clear();                                                  \
+    if (adel_s[0].done())
+
+#define aramp( T, v, start, end)                                        \
+    adel_ramp_start = adel_now;                                         \
+    adel_debug("aramp", __LINE__);                                      \
+    while (adel_ramp(adel_ramp_start, T, start, end, v))
+
+#define alternate( f , g )                                              \
+    adel_c[0] = f;                                                      \
+    adel_c[1] = g;                                                      \
+    adel_k = 0;                                                         \
+    adel_debug("alternate", __LINE__);                                  \
+    while ((adel_s[adel_k] = adel_c[adel_k].step()).notdone()) {        \
+        if (adel_s[adel_k].yield()) {                                   \
+            adel_k = 1 - adel_k;                                        \
+            co_await AdelTask::next();                                  \
+        } else                                                          \
+            co_await AdelTask::waitchildren(&adel_c[adel_k], &adel_s[adel_k], 1); \
+    }                                                                   \
+    adel_c[0].clear();                                                  \
+    adel_c[1].clear();
+
+#define ayourturn                                                       \
+    adel_debug("ayourturn", __LINE__);                                  \
+    co_await AdelTask::yourturn();
+
+#define afinish                                                         \
+    adel_debug("afinish", __LINE__);                                    \
+    co_return;
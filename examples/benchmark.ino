@@ -0,0 +1,255 @@
+#define ADEL_POOL_BYTES 512
+
+// -- Uncomment to compare direct calls between functions with the usual
+//    virtual calls (see ADEL_STATIC in adel.h)
+// #define ADEL_STATIC 1
+
+#include <adel.h>
+
+/** Adel benchmark
+ *
+ *  Measures the overhead of the Adel runtime on the board itself and
+ *  prints the results as CSV over the serial port, so that numbers from
+ *  different versions of the library (or different boards) can be
+ *  compared side by side. There are two kinds of rows:
+ *
+ *    pass      -- time for one pass over a tree of running functions,
+ *                 "width" functions side by side, each "depth" calls deep
+ *    <construct> -- time to enter and leave the construct once, with
+ *                 callees that finish right away
+ *
+ *  The allocs and bytes columns come from the activation record pool:
+ *  how many records the tree (or one use of the construct) allocates, and
+ *  how many bytes they take in total. They are counted even when a record
+ *  does not fit in the pool. The sizes are chosen to fit on an Uno. The
+ *  last column says whether the sketch was built with ADEL_STATIC.
+ */
+
+#define PASSES  1000
+#define ENTRIES 200
+
+// -- Set to stop all the running functions at the end of a test
+bool stop;
+
+// -- Counts iterations of aramp
+uint32_t ramps;
+
+#ifdef ADEL_STATIC
+#define MODE "static"
+#else
+#define MODE "virtual"
+#endif
+
+/** chain
+ *
+ *  A stack of D functions, each waiting on the next. The innermost one
+ *  polls a condition, so the whole chain runs on every pass. The depth is
+ *  a template parameter because with ADEL_STATIC a function cannot call
+ *  itself. The argument is the chain's index in the tree, and is unused.
+ */
+template<int D>
+adel chain(int)
+{
+  abegin:
+  andthen( chain<D - 1>(0) );
+  aend;
+}
+
+template<>
+adel chain<1>(int)
+{
+  abegin:
+  await( stop );
+  aend;
+}
+
+int chainid[8];
+
+template<int D>
+adel tree(int width)
+{
+  abegin:
+  aforeach( chainid, width, chain<D> );
+  aend;
+}
+
+/** Callees for the construct tests
+ */
+adel quick()
+{
+  abegin:
+  aend;
+}
+
+adel quickyield()
+{
+  abegin:
+  ayourturn;
+  aend;
+}
+
+adel enter_andthen()
+{
+  int i;
+  abegin:
+  for (i = 0; i < ENTRIES; i++) {
+    andthen( quick() );
+  }
+  aend;
+}
+
+adel enter_aboth()
+{
+  int i;
+  abegin:
+  for (i = 0; i < ENTRIES; i++) {
+    aboth( quick(), quick() );
+  }
+  aend;
+}
+
+adel enter_auntil()
+{
+  int i;
+  abegin:
+  for (i = 0; i < ENTRIES; i++) {
+    auntil( quick(), quick() ) { }
+  }
+  aend;
+}
+
+adel enter_aforatmost()
+{
+  int i;
+  abegin:
+  for (i = 0; i < ENTRIES; i++) {
+    aforatmost( 1000, quick() ) { }
+  }
+  aend;
+}
+
+adel enter_alternate()
+{
+  int i;
+  abegin:
+  for (i = 0; i < ENTRIES; i++) {
+    alternate( quickyield(), quick() );
+  }
+  aend;
+}
+
+adel enter_aramp()
+{
+  int v;
+  abegin:
+  ramps = 0;
+  aramp( 100, v, 0, 255 ) {
+    ramps++;
+  }
+  aend;
+}
+
+AdelRuntime bench;
+
+void row(const char * test, int width, int depth, uint32_t ns,
+         uint32_t allocs, uint32_t bytes)
+{
+  Serial.print(test);
+  Serial.print(",");
+  Serial.print(width);
+  Serial.print(",");
+  Serial.print(depth);
+  Serial.print(",");
+  Serial.print(ns);
+  Serial.print(",");
+  Serial.print(allocs);
+  Serial.print(",");
+  Serial.print(bytes);
+  Serial.print(",");
+  Serial.println(MODE);
+}
+
+/** Time one pass over a tree of width x D running functions
+ */
+template<int D>
+void passes(int width)
+{
+  for (int i = 0; i < width; i++) chainid[i] = i;
+  stop = false;
+  AdelRuntime::curStack = &bench;
+  AdelRuntime::safeCall = true;
+
+  uint32_t allocs = AdelPool::allocs();
+  uint32_t bytes = AdelPool::allocbytes();
+  bench.init( tree<D>(width) );
+  // -- First pass builds the tree
+  bench.run();
+  allocs = AdelPool::allocs() - allocs;
+  bytes = AdelPool::allocbytes() - bytes;
+
+  uint32_t start = micros();
+  for (int i = 0; i < PASSES; i++) bench.run();
+  uint32_t elapsed = micros() - start;
+
+  stop = true;
+  while ( ! bench.run().done()) ;
+  bench.reset();
+
+  row("pass", width, D, (elapsed * 1000) / PASSES, allocs, bytes);
+}
+
+/** Time ENTRIES uses of a construct, which all happen in one pass. The
+ *  AR for the test function itself is allocated before we start counting.
+ */
+void entries(const char * name, AdelAR * f)
+{
+  AdelRuntime::curStack = &bench;
+  uint32_t allocs = AdelPool::allocs();
+  uint32_t bytes = AdelPool::allocbytes();
+  uint32_t start = micros();
+  bench.init(f);
+  while ( ! bench.run().done()) ;
+  bench.reset();
+  uint32_t elapsed = micros() - start;
+  allocs = AdelPool::allocs() - allocs;
+  bytes = AdelPool::allocbytes() - bytes;
+
+  row(name, 1, 1, (elapsed * 1000) / ENTRIES,
+      (allocs + ENTRIES / 2) / ENTRIES, (bytes + ENTRIES / 2) / ENTRIES);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial);
+  delay(500);
+
+  Serial.println("test,width,depth,ns,allocs,bytes,mode");
+
+  int widths[] = { 1, 4, 8 };
+  for (int w = 0; w < 3; w++) {
+    passes<1>(widths[w]);
+    passes<2>(widths[w]);
+    passes<4>(widths[w]);
+  }
+
+  AdelRuntime::safeCall = true;
+  entries("andthen", enter_andthen());
+  entries("aboth", enter_aboth());
+  entries("auntil", enter_auntil());
+  entries("aforatmost", enter_aforatmost());
+  entries("alternate", enter_alternate());
+
+  // -- aramp allocates nothing; report the time per iteration instead
+  AdelRuntime::curStack = &bench;
+  bench.init( enter_aramp() );
+  while ( ! bench.run().done()) ;
+  bench.reset();
+  row("aramp", 1, 1, ramps ? 100000000UL / ramps : 0, 0, 0);
+
+  Serial.println("done");
+}
+
+void loop()
+{
+}
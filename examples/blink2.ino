@@ -46,7 +46,7 @@ adel blink(int pin, int interval)
 adel blink2()
 {
   abegin:
-  atogether( blink(LED_PIN_1, 300), blink(LED_PIN_2, 800) );
+  aboth( blink(LED_PIN_1, 300), blink(LED_PIN_2, 800) );
   aend;
 }
 
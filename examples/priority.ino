@@ -0,0 +1,160 @@
+// -- Set to 0 to run the same functions with plain arepeat, one pass
+//    each in source order
+#ifndef PRIORITIES
+#define PRIORITIES 1
+#endif
+
+#include <adel.h>
+
+/** Adel priority benchmark
+ *
+ *  Measures how long a latency-critical function (think of a motor
+ *  controller) takes to respond to a request while NEIGHBOURS slow
+ *  functions (think of display refreshes) share the loop with it. Each
+ *  neighbour keeps the processor busy for WORK_US per pass. The request
+ *  is raised at the end of a pass of a neighbour chosen at random, as if
+ *  an interrupt had arrived while that neighbour was running.
+ *
+ *  A second high-priority function (think of a stepper) wakes up every
+ *  millisecond with adelay, and measures how late it wakes up each time.
+ *
+ *  After TRIALS requests the sketch prints one CSV row with the worst and
+ *  mean response time in microseconds, and the number of ticks and the
+ *  worst lateness of a tick. Run it once with PRIORITIES
+ *  set to 1 and once to 0, and compare: without priorities the motor
+ *  waits for the rest of the loop, with priorities it waits at most for
+ *  the pass that was running.
+ */
+
+#define NEIGHBOURS 10
+#define WORK_US    500
+#define TRIALS     500
+
+#if PRIORITIES
+#define MODE "priority"
+#else
+#define MODE "sourceorder"
+#endif
+
+// -- The pending request, and when it was raised
+bool request;
+uint32_t requested;
+
+// -- The neighbour that raises the next request
+int raiser;
+uint16_t seed = 1;
+
+// -- Response times
+uint32_t worst;
+uint32_t total;
+uint16_t trials;
+bool reported;
+
+// -- Ticks, and how late the worst one was
+uint32_t ticks;
+uint32_t latest;
+
+adel motor()
+{
+  abegin:
+  while (1) {
+    await( request );
+    request = false;
+    if (micros() - requested > worst) worst = micros() - requested;
+    total += micros() - requested;
+    trials++;
+  }
+  aend;
+}
+
+adel ticker()
+{
+  uint32_t due;
+  abegin:
+  while (1) {
+    due = (adel_now + 1) * 1000UL;
+    adelay( 1 );
+    if (micros() - due > latest) latest = micros() - due;
+    ticks++;
+  }
+  aend;
+}
+
+adel neighbour(int id)
+{
+  abegin:
+  while (1) {
+    delayMicroseconds(WORK_US);
+    if ( ! request && id == raiser) {
+      request = true;
+      requested = micros();
+      seed = seed * 25173 + 13849;
+      raiser = (seed >> 8) % NEIGHBOURS;
+    }
+    adelay( 1 );
+  }
+  aend;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial);
+  delay(500);
+
+  Serial.println("mode,neighbours,work_us,trials,worst_us,mean_us,ticks,tick_worst_us");
+}
+
+void loop()
+{
+  if (reported) return;
+
+#if PRIORITIES
+  arepeat_at( 1, motor() );
+  arepeat_at( 1, ticker() );
+  arepeat_at( 0, neighbour(0) );
+  arepeat_at( 0, neighbour(1) );
+  arepeat_at( 0, neighbour(2) );
+  arepeat_at( 0, neighbour(3) );
+  arepeat_at( 0, neighbour(4) );
+  arepeat_at( 0, neighbour(5) );
+  arepeat_at( 0, neighbour(6) );
+  arepeat_at( 0, neighbour(7) );
+  arepeat_at( 0, neighbour(8) );
+  arepeat_at( 0, neighbour(9) );
+  adel_dispatch();
+#else
+  arepeat( motor() );
+  arepeat( ticker() );
+  arepeat( neighbour(0) );
+  arepeat( neighbour(1) );
+  arepeat( neighbour(2) );
+  arepeat( neighbour(3) );
+  arepeat( neighbour(4) );
+  arepeat( neighbour(5) );
+  arepeat( neighbour(6) );
+  arepeat( neighbour(7) );
+  arepeat( neighbour(8) );
+  arepeat( neighbour(9) );
+#endif
+
+  if (trials >= TRIALS) {
+    Serial.print(MODE);
+    Serial.print(",");
+    Serial.print(NEIGHBOURS);
+    Serial.print(",");
+    Serial.print(WORK_US);
+    Serial.print(",");
+    Serial.print(trials);
+    Serial.print(",");
+    Serial.print(worst);
+    Serial.print(",");
+    Serial.print(total / trials);
+    Serial.print(",");
+    Serial.print(ticks);
+    Serial.print(",");
+    Serial.println(latest);
+    Serial.println("done");
+    reported = true;
+  }
+}
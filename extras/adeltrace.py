@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Turn an Adel trace dump into a readable timeline.
+
+Build the sketch with ADEL_TRACE defined, call adel_trace_dump() when
+something interesting has happened, and save the serial output to a file.
+Other serial output around the dump is ignored. Then run:
+
+    python3 adeltrace.py capture.txt
+
+Each line of the timeline shows the time since the first event, the time
+since the previous event, and the construct that was entered.
+
+With --chrome, write Chrome trace event JSON instead, which you can open in
+chrome://tracing or https://ui.perfetto.dev:
+
+    python3 adeltrace.py --chrome capture.txt > capture.json
+
+Each activation record gets a track of its own, named after its function.
+Each pass through the function is a slice on that track, so the gaps
+between slices are the time it spent waiting (in adelay, for example), and
+the constructs it entered are marked inside the slices.
+"""
+
+import json
+import sys
+
+
+def read_events(lines):
+    """Yield (lost, events) for each dump found in the lines."""
+    events = None
+    lost = 0
+    for line in lines:
+        line = line.strip()
+        if line.startswith("adeltrace,"):
+            lost = int(line.split(",", 1)[1])
+            events = []
+        elif events is None:
+            continue
+        elif line == "end":
+            yield lost, events
+            events = None
+        else:
+            t, ar, fn, ln, kind = line.split(",", 4)
+            events.append((int(t), ar, fn, int(ln), kind))
+
+
+def timeline(lost, events, out):
+    if lost:
+        out.write("(%d earlier events were overwritten)\n" % lost)
+    if not events:
+        out.write("(no events)\n")
+        return
+    start = prev = events[0][0]
+    out.write("%12s %10s  %s\n" % ("ms", "+us", "event"))
+    for t, ar, fn, ln, kind in events:
+        if fn == "-":
+            continue
+        # -- micros() is 32 bits, so differences are taken modulo 2^32
+        since = (t - start) & 0xFFFFFFFF
+        delta = (t - prev) & 0xFFFFFFFF
+        out.write("%12.3f %10d  %s in %s:%d\n" % (since / 1000.0, delta, kind, fn, ln))
+        prev = t
+
+
+def chrome(dumps, out):
+    trace = []
+    names = {}
+    tid = 0
+    for pid, (lost, events) in enumerate(dumps):
+        if not events:
+            continue
+        # -- A record that is freed and allocated again at the same address
+        #    starts a new track, so tracks map addresses to the current one
+        tracks = {}
+        running = {}
+        prev = events[0][0]
+        ts = 0
+        for t, ar, fn, ln, kind in events:
+            # -- micros() is 32 bits, so differences are taken modulo 2^32
+            ts += (t - prev) & 0xFFFFFFFF
+            prev = t
+            if ar not in tracks:
+                tid += 1
+                tracks[ar] = tid
+                names[(pid, tid)] = "?"
+            track = tracks[ar]
+            if fn != "-" and names[(pid, track)] == "?":
+                names[(pid, track)] = fn
+            if kind == "resume":
+                running[track] = ts
+                trace.append({"ph": "B", "ts": ts, "pid": pid, "tid": track})
+            elif kind == "suspend":
+                # -- The matching resume may have been overwritten
+                if running.pop(track, None) is not None:
+                    trace.append({"ph": "E", "ts": ts, "pid": pid, "tid": track})
+            elif kind == "free":
+                del tracks[ar]
+            else:
+                trace.append({"ph": "i", "s": "t", "name": kind, "ts": ts,
+                              "pid": pid, "tid": track, "args": {"line": ln}})
+        for track in running:
+            trace.append({"ph": "E", "ts": ts, "pid": pid, "tid": track})
+    for e in trace:
+        if e["ph"] == "B":
+            e["name"] = names[(e["pid"], e["tid"])]
+    for (pid, track), name in names.items():
+        trace.append({"ph": "M", "name": "thread_name", "pid": pid,
+                      "tid": track, "args": {"name": "%s %d" % (name, track)}})
+    json.dump({"traceEvents": trace, "displayTimeUnit": "ms"}, out)
+    out.write("\n")
+
+
+def main(argv):
+    args = [a for a in argv[1:] if a != "--chrome"]
+    f = open(args[0]) if args else sys.stdin
+    dumps = list(read_events(f))
+    if not dumps:
+        sys.stderr.write("no adeltrace dump found\n")
+        return 1
+    if "--chrome" in argv:
+        chrome(dumps, sys.stdout)
+        return 0
+    for i, (lost, events) in enumerate(dumps):
+        if i:
+            sys.stdout.write("\n")
+        timeline(lost, events, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,145 @@
+/** Arduino.h for the host build
+ *
+ *  Just enough of the Arduino core to compile Adel and its examples on a
+ *  desktop machine. Time is a virtual clock that only moves when the
+ *  program says so (see host_advance_us), so that every run is exactly
+ *  the same, and so that tests can put the clock anywhere they like --
+ *  for example just before millis() wraps around.
+ */
+#ifndef ADEL_HOST_ARDUINO_H
+#define ADEL_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+// ------------------------------------------------------------
+//   Virtual clock
+
+/** host_clock_us
+ *
+ *  The time in microseconds since the program started. It is 64 bits
+ *  wide, so millis() and micros() wrap around at 2^32 independently, as
+ *  they do on the board. host_tick_us is added on every read of the clock;
+ *  it is zero by default, which makes the program infinitely fast.
+ */
+extern uint64_t host_clock_us;
+extern uint32_t host_tick_us;
+
+inline void host_advance_us(uint64_t us) { host_clock_us += us; }
+inline void host_set_us(uint64_t us) { host_clock_us = us; }
+
+// -- Put the clock at the given millis() value
+inline void host_set_ms(uint32_t ms) { host_clock_us = (uint64_t) ms * 1000; }
+
+inline uint32_t micros()
+{
+    host_clock_us += host_tick_us;
+    return (uint32_t) host_clock_us;
+}
+
+inline uint32_t millis()
+{
+    host_clock_us += host_tick_us;
+    return (uint32_t) (host_clock_us / 1000);
+}
+
+inline void delay(uint32_t ms) { host_clock_us += (uint64_t) ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { host_clock_us += us; }
+
+// ------------------------------------------------------------
+//   Pins
+
+#define HOST_PINS 64
+
+/** host_pins
+ *
+ *  The last value written to each pin, and the value read from it.
+ *  host_writes counts digitalWrite and analogWrite calls.
+ */
+extern int host_pins[HOST_PINS];
+extern uint32_t host_writes;
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t pin) { return host_pins[pin]; }
+inline void digitalWrite(uint8_t pin, uint8_t v) { host_pins[pin] = v; host_writes++; }
+inline int analogRead(uint8_t pin) { return host_pins[pin]; }
+inline void analogWrite(uint8_t pin, int v) { host_pins[pin] = v; host_writes++; }
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// ------------------------------------------------------------
+//   Serial
+
+/** HostSerial
+ *
+ *  Output goes to stdout. Input comes from host_input, so that a test can
+ *  type at a sketch.
+ */
+class HostSerial
+{
+private:
+    const char * input;
+
+public:
+    HostSerial() : input("") {}
+
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+
+    void host_input(const char * s) { input = s; }
+    int available() const { return (int) strlen(input); }
+    int read() { return *input ? *input++ : -1; }
+
+    void print(const char * s) { fputs(s, stdout); }
+    void print(char c) { putchar(c); }
+    void print(int v, int base = DEC) { print((long) v, base); }
+    void print(unsigned int v, int base = DEC) { print((unsigned long) v, base); }
+    void print(long v, int base = DEC)
+    {
+        if (base == DEC) printf("%ld", v);
+        else print((unsigned long) v, base);
+    }
+    void print(unsigned long v, int base = DEC)
+    {
+        if (base == HEX) printf("%lX", v);
+        else printf("%lu", v);
+    }
+    void print(double v, int digits = 2) { printf("%.*f", digits, v); }
+
+    void println() { putchar('\n'); }
+    template<typename T>
+    void println(T v) { print(v); println(); }
+    template<typename T>
+    void println(T v, int f) { print(v, f); println(); }
+};
+
+extern HostSerial Serial;
+
+#endif
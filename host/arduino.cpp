@@ -0,0 +1,9 @@
+#include <Arduino.h>
+
+uint64_t host_clock_us = 0;
+uint32_t host_tick_us = 0;
+
+int host_pins[HOST_PINS];
+uint32_t host_writes = 0;
+
+HostSerial Serial;
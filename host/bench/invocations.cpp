@@ -0,0 +1,77 @@
+/** Lambda invocations per second
+ *
+ *  40 blinkers, in pairs under 20 top-level functions, with loop() running
+ *  ten times per millisecond. Reports how many function bodies would be
+ *  invoked per second if every live AR were polled on every pass, which
+ *  is what the runtime did before it learned to skip sleeping subtrees,
+ *  and how many are actually invoked (ADEL_PROFILE counts every pass
+ *  through a body).
+ *
+ *  Prints one CSV row: functions,passes_per_s,polled_per_s,invoked_per_s
+ */
+#define ADEL_PROFILE 4
+#define ADEL_MEMSTATS 1
+#include <adel.h>
+
+#define PAIRS      20
+#define STEP_US    100
+#define MEASURE_MS 10000
+
+adel blink(int pin, int interval)
+{
+  abegin:
+  while (1) {
+    digitalWrite(pin, HIGH);
+    adelay(interval);
+    digitalWrite(pin, LOW);
+    adelay(interval);
+  }
+  aend;
+}
+
+adel pair(int n)
+{
+  abegin:
+  aboth(blink(n, 50 + 7 * n), blink(n + PAIRS, 80 + 11 * n));
+  aend;
+}
+
+AdelRuntime runtimes[PAIRS];
+
+void loop()
+{
+  for (int i = 0; i < PAIRS; i++) {
+    AdelRuntime::curStack = & runtimes[i];
+    if (runtimes[i].not_running()) {
+      AdelRuntime::safeCall = true;
+      runtimes[i].init(pair(i));
+    }
+    runtimes[i].run();
+  }
+}
+
+int main()
+{
+  // -- Get everything started, then count
+  loop();
+  AdelProfile::clear();
+
+  uint32_t passes = 0;
+  uint32_t polled = 0;
+  uint64_t end = host_clock_us + (uint64_t) MEASURE_MS * 1000;
+  while (host_clock_us < end) {
+    polled += AdelMemStats::total().live;
+    loop();
+    passes++;
+    host_advance_us(STEP_US);
+  }
+  uint32_t invoked = AdelProfile::passes();
+
+  uint32_t seconds = MEASURE_MS / 1000;
+  printf("functions,passes_per_s,polled_per_s,invoked_per_s\n");
+  printf("%u,%u,%u,%u\n", (unsigned) AdelMemStats::total().live,
+         (unsigned) (passes / seconds), (unsigned) (polled / seconds),
+         (unsigned) (invoked / seconds));
+
+  return invoked * 10 < polled ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/** Microsecond delays under load
+ *
+ *  20 top-level functions, each waking every 100 us to do 1 us of work.
+ *  Every read of the clock costs 1 us, which stands in for the time the
+ *  runtime itself takes, so that a round in which every function wakes
+ *  up takes 80 us, and the functions get in each other's way.
+ *  Reports the period each function actually achieved, and how late it
+ *  woke up compared to its own deadline. The command line picks the
+ *  construct:
+ *
+ *    relative  -- adelay_us(100), counted from when the function wakes
+ *    absolute  -- adelay_until_us, counted from the previous deadline
+ *
+ *  Prints one CSV row:
+ *    mode,tasks,period_us,mean_us,min_us,max_us,mean_late_us,max_late_us
+ *
+ *  Fails if the absolute form does not keep the mean period within 1% of
+ *  the one asked for, or if any function falls a whole period behind.
+ */
+#include <adel.h>
+
+#define TASKS      20
+#define PERIOD_US  100
+#define WORK_US    1
+#define MEASURE_MS 1000
+
+bool absolute;
+bool measuring;
+uint32_t last[TASKS];
+
+uint32_t wakeups, total, shortest = 0xFFFFFFFF, longest;
+uint32_t late, latest;
+
+// -- Called right after the wait, with the deadline the function had
+void record(int n, uint32_t deadline)
+{
+  uint32_t now = micros();
+  if (measuring && last[n]) {
+    uint32_t period = now - last[n];
+    uint32_t behind = now - deadline;
+    wakeups++;
+    total += period;
+    if (period < shortest) shortest = period;
+    if (period > longest) longest = period;
+    late += behind;
+    if (behind > latest) latest = behind;
+  }
+  last[n] = now;
+}
+
+adel step(int n)
+{
+  uint32_t next;
+  abegin:
+  next = micros();
+  while (1) {
+    if (absolute) {
+      next += PERIOD_US;
+      adelay_until_us( next );
+    } else {
+      adelay_us( PERIOD_US );
+    }
+    record(n, adel_wait);
+    delayMicroseconds(WORK_US);
+  }
+  aend;
+}
+
+AdelRuntime runtimes[TASKS];
+
+void loop()
+{
+  for (int i = 0; i < TASKS; i++) {
+    AdelRuntime::curStack = & runtimes[i];
+    if (runtimes[i].not_running()) {
+      AdelRuntime::safeCall = true;
+      runtimes[i].init(step(i));
+    }
+    runtimes[i].run();
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  absolute = argc > 1 && strcmp(argv[1], "absolute") == 0;
+  host_tick_us = 1;
+
+  // -- Let the functions spread out before measuring
+  uint64_t end = host_clock_us + 100000;
+  while (host_clock_us < end) loop();
+
+  measuring = true;
+  end = host_clock_us + (uint64_t) MEASURE_MS * 1000;
+  while (host_clock_us < end) loop();
+
+  uint32_t mean = total / wakeups;
+  printf("mode,tasks,period_us,mean_us,min_us,max_us,mean_late_us,max_late_us\n");
+  printf("%s,%d,%d,%u,%u,%u,%u,%u\n", absolute ? "absolute" : "relative",
+         TASKS, PERIOD_US, (unsigned) mean, (unsigned) shortest,
+         (unsigned) longest, (unsigned) (late / wakeups), (unsigned) latest);
+
+  if ( ! absolute) return 0;
+  if (mean * 100 < PERIOD_US * 99 || mean * 100 > PERIOD_US * 101) return 1;
+  return latest < PERIOD_US ? 0 : 1;
+}
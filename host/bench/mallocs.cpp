@@ -0,0 +1,67 @@
+/** Heap allocations in the steady state
+ *
+ *  Runs examples/gentlelight.ino, pressing its button twice a second, and
+ *  counts the calls to malloc (through the linker's --wrap) once the
+ *  program has warmed up. Every andthen in gentlelight makes a new AR,
+ *  so without a pool each one is a malloc. With ADEL_POOL_BYTES, there
+ *  must be none at all.
+ *
+ *  Prints one CSV row: mode,seconds,presses,mallocs
+ */
+#include <Arduino.h>
+
+// -- BUTTON_PIN in gentlelight.ino
+#define BUTTON 6
+
+#define WARMUP_MS  5000
+#define MEASURE_MS 60000
+
+void setup();
+void loop();
+
+static uint32_t mallocs;
+
+extern "C" void * __real_malloc(size_t sz);
+extern "C" void * __wrap_malloc(size_t sz)
+{
+    mallocs++;
+    return __real_malloc(sz);
+}
+
+static uint32_t presses;
+
+// -- Run the sketch for ms milliseconds, holding the button down for the
+//    first 100 ms of every 500
+static void run(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++) {
+        uint32_t phase = millis() % 500;
+        if (phase == 0) presses++;
+        host_pins[BUTTON] = phase < 100 ? HIGH : LOW;
+        loop();
+        host_advance_us(1000);
+    }
+}
+
+int main()
+{
+    setup();
+    run(WARMUP_MS);
+    mallocs = 0;
+    presses = 0;
+    run(MEASURE_MS);
+
+#ifdef ADEL_POOL_BYTES
+    const char * mode = "pool";
+#else
+    const char * mode = "heap";
+#endif
+    printf("mode,seconds,presses,mallocs\n");
+    printf("%s,%u,%u,%u\n", mode, MEASURE_MS / 1000, (unsigned) presses, (unsigned) mallocs);
+
+#ifdef ADEL_POOL_BYTES
+    return mallocs == 0 ? 0 : 1;
+#else
+    return mallocs > 0 ? 0 : 1;
+#endif
+}
@@ -0,0 +1,59 @@
+/** Wasted wakeups
+ *
+ *  Runs a sketch for a minute of virtual time, with nobody touching the
+ *  buttons, and counts the calls to loop() that were wasted:
+ *
+ *    empty     -- no Adel function body ran at all (ADEL_PROFILE counts
+ *                 the passes through the bodies)
+ *    nowrite   -- no pin was written, so the pass at most polled
+ *
+ *  With "spin", loop() runs once per millisecond, as if the processor
+ *  never slept. With "idle", loop() is followed by adel_idle(), which skips
+ *  the clock ahead to the next deadline whenever every function is asleep.
+ *  A function polling in await keeps it awake.
+ *
+ *  Prints one CSV row: mode,wakeups,empty,nowrite
+ */
+#include <adel.h>
+
+#define RUN_MS 60000
+
+void setup();
+void loop();
+
+static uint64_t end;
+
+static void sleep(uint32_t ms)
+{
+    if (ms == ADEL_FOREVER) host_clock_us = end;
+    else host_advance_us((uint64_t) ms * 1000);
+}
+
+int main(int argc, char ** argv)
+{
+    bool idle = argc > 1 && strcmp(argv[1], "idle") == 0;
+    if (idle) AdelRuntime::sleepfn = sleep;
+
+    setup();
+    end = host_clock_us + (uint64_t) RUN_MS * 1000;
+
+    uint32_t wakeups = 0;
+    uint32_t empty = 0;
+    uint32_t nowrite = 0;
+    while (host_clock_us < end) {
+        uint32_t passes = AdelProfile::passes();
+        uint32_t writes = host_writes;
+        loop();
+        wakeups++;
+        if (AdelProfile::passes() == passes) empty++;
+        if (host_writes == writes) nowrite++;
+        uint64_t t = host_clock_us;
+        adel_idle();
+        if (host_clock_us == t) host_advance_us(1000);
+    }
+
+    printf("mode,wakeups,empty,nowrite\n");
+    printf("%s,%u,%u,%u\n", idle ? "idle" : "spin",
+           (unsigned) wakeups, (unsigned) empty, (unsigned) nowrite);
+    return 0;
+}
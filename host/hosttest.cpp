@@ -0,0 +1,45 @@
+#include <stdarg.h>
+#include "hosttest.h"
+
+int host_failures = 0;
+uint32_t host_log_base = 0;
+
+static char host_logbuf[8192];
+static size_t host_loglen = 0;
+
+void host_check_at(bool ok, const char * what, const char * file, int line)
+{
+    if (ok) return;
+    printf("%s:%d: check failed: %s\n", file, line, what);
+    host_failures++;
+}
+
+void host_log(const char * fmt, ...)
+{
+    size_t room = sizeof(host_logbuf) - host_loglen;
+    int n = snprintf(host_logbuf + host_loglen, room, "%u ",
+                     (unsigned) (millis() - host_log_base));
+    if (n > 0 && (size_t) n < room) host_loglen += n;
+
+    va_list args;
+    va_start(args, fmt);
+    room = sizeof(host_logbuf) - host_loglen;
+    n = vsnprintf(host_logbuf + host_loglen, room, fmt, args);
+    va_end(args);
+    if (n > 0 && (size_t) n < room) host_loglen += n;
+
+    if (host_loglen + 1 < sizeof(host_logbuf)) host_logbuf[host_loglen++] = '\n';
+    host_logbuf[host_loglen] = 0;
+}
+
+void host_expect_at(const char * lines, const char * file, int line)
+{
+    host_logbuf[host_loglen] = 0;
+    if (strcmp(host_logbuf, lines) != 0) {
+        printf("%s:%d: log differs\n--- expected\n%s--- got\n%s---\n",
+               file, line, lines, host_logbuf);
+        host_failures++;
+    }
+    host_loglen = 0;
+    host_logbuf[0] = 0;
+}
@@ -0,0 +1,29 @@
+/** Helpers for the host tests
+ *
+ *  host_check counts a failure and keeps going, so that one run shows
+ *  everything that is wrong. Tests that care about the order of events
+ *  write them with host_log and compare the whole log with host_expect.
+ *  main() returns host_failures.
+ */
+#ifndef ADEL_HOST_TEST_H
+#define ADEL_HOST_TEST_H
+
+#include <Arduino.h>
+
+extern int host_failures;
+
+#define host_check(c) host_check_at((c), #c, __FILE__, __LINE__)
+
+void host_check_at(bool ok, const char * what, const char * file, int line);
+
+// -- Add a line to the log, prefixed with millis() - host_log_base
+extern uint32_t host_log_base;
+
+void host_log(const char * fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// -- Compare the log with the expected lines, and empty it
+#define host_expect(lines) host_expect_at(lines, __FILE__, __LINE__)
+
+void host_expect_at(const char * lines, const char * file, int line);
+
+#endif
@@ -0,0 +1,33 @@
+/** Host driver for a sketch
+ *
+ *  Calls setup() once, then loop() until HOST_RUN_MS of virtual time has
+ *  gone by, moving the clock HOST_STEP_US after every call. With
+ *  HOST_TICK_US, the clock also moves on every read, for sketches that
+ *  time themselves.
+ */
+#include <Arduino.h>
+
+#ifndef HOST_RUN_MS
+#define HOST_RUN_MS 20000
+#endif
+
+#ifndef HOST_STEP_US
+#define HOST_STEP_US 1000
+#endif
+
+void setup();
+void loop();
+
+int main()
+{
+#ifdef HOST_TICK_US
+    host_tick_us = HOST_TICK_US;
+#endif
+    setup();
+    uint64_t end = host_clock_us + (uint64_t) HOST_RUN_MS * 1000;
+    while (host_clock_us < end) {
+        loop();
+        host_advance_us(HOST_STEP_US);
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/** Allocation counts
+ *
+ *  AdelPool::allocs() counts every AR a tree needs, including the root
+ *  that reuses the memory its runtime kept from the last run.
+ */
+#define ADEL_POOL_BYTES 1024
+#include <adel.h>
+#include "hosttest.h"
+
+adel leaf()
+{
+  abegin:
+  adelay(1);
+  aend;
+}
+
+adel tree()
+{
+  abegin:
+  aboth(leaf(), leaf());
+  andthen(leaf());
+  aend;
+}
+
+AdelRuntime runtime;
+
+uint32_t run()
+{
+  uint32_t before = AdelPool::allocs();
+  AdelRuntime::curStack = & runtime;
+  AdelRuntime::safeCall = true;
+  runtime.init(tree());
+  while ( ! runtime.run().done()) host_advance_us(1000);
+  runtime.reset();
+  return AdelPool::allocs() - before;
+}
+
+int main()
+{
+  // -- The root, two leaves in aboth, and one in andthen
+  for (int i = 0; i < 3; i++)
+    host_check(run() == 4);
+  host_check(AdelPool::fallbacks() == 0);
+
+  return host_failures;
+}
@@ -0,0 +1,174 @@
+/** Cancellation cascade
+ *
+ *  When auntil, aforatmost, or aany stops a function, the afinally blocks
+ *  of everything it was running must run exactly once, children before
+ *  their parents, and before the construct moves on.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+adel leaf(int id)
+{
+  abegin:
+  while (1) {
+    adelay(5);
+  }
+  afinally {
+    host_log("leaf %d cleanup", id);
+  }
+  aend;
+}
+
+adel mid(int id)
+{
+  abegin:
+  aboth(leaf(id * 10), leaf(id * 10 + 1));
+  afinally {
+    host_log("mid %d cleanup", id);
+  }
+  aend;
+}
+
+adel deep(int id)
+{
+  abegin:
+  andthen(mid(id));
+  afinally {
+    host_log("deep %d cleanup", id);
+  }
+  aend;
+}
+
+adel timeout(int t)
+{
+  abegin:
+  adelay(t);
+  aend;
+}
+
+adel normal()
+{
+  abegin:
+  adelay(2);
+  afinally {
+    host_log("normal cleanup");
+  }
+  aend;
+}
+
+adel early()
+{
+  abegin:
+  adelay(2);
+  afinish;
+  host_log("never");
+  afinally {
+    host_log("early cleanup");
+  }
+  aend;
+}
+
+adel_of<int> value()
+{
+  abegin:
+  areturn(4);
+  afinally {
+    host_log("value cleanup");
+  }
+  aend;
+}
+
+adel nofinally()
+{
+  abegin:
+  while (1) {
+    adelay(1);
+  }
+  aend;
+}
+
+adel stopped_by_until()
+{
+  abegin:
+  auntil(timeout(12), mid(1)) {
+    host_log("timeout won");
+  }
+  aend;
+}
+
+adel stopped_by_foratmost()
+{
+  abegin:
+  aforatmost(7, deep(2)) {
+    host_log("aforatmost timeout");
+  }
+  aend;
+}
+
+adel stopped_by_any()
+{
+  abegin:
+  aany(timeout(1), mid(3), leaf(4));
+  host_log("aany done");
+  aend;
+}
+
+adel finished()
+{
+  int x = 0;
+  abegin:
+  andthen(normal());
+  andthen(early());
+  andthen_get(x, value());
+  host_log("x=%d", x);
+  aforatmost(3, nofinally()) {
+    host_log("nofinally stopped");
+  }
+  aend;
+}
+
+AdelRuntime runtime;
+
+void finish(AdelAR * f)
+{
+  AdelRuntime::curStack = & runtime;
+  runtime.init(f);
+  while ( ! runtime.run().done()) host_advance_us(1000);
+  runtime.reset();
+}
+
+int main()
+{
+  AdelRuntime::safeCall = true;
+  finish(stopped_by_until());
+  host_expect("12 leaf 10 cleanup\n"
+              "12 leaf 11 cleanup\n"
+              "12 mid 1 cleanup\n"
+              "12 timeout won\n");
+
+  AdelRuntime::safeCall = true;
+  finish(stopped_by_foratmost());
+  host_expect("19 leaf 20 cleanup\n"
+              "19 leaf 21 cleanup\n"
+              "19 mid 2 cleanup\n"
+              "19 deep 2 cleanup\n"
+              "19 aforatmost timeout\n");
+
+  AdelRuntime::safeCall = true;
+  finish(stopped_by_any());
+  host_expect("20 leaf 30 cleanup\n"
+              "20 leaf 31 cleanup\n"
+              "20 mid 3 cleanup\n"
+              "20 leaf 4 cleanup\n"
+              "20 aany done\n");
+
+  AdelRuntime::safeCall = true;
+  finish(finished());
+  host_expect("22 normal cleanup\n"
+              "25 early cleanup\n"
+              "26 value cleanup\n"
+              "26 x=4\n"
+              "29 nofinally stopped\n");
+
+  return host_failures;
+}
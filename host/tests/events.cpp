@@ -0,0 +1,73 @@
+/** Parked functions and many signals
+ *
+ *  A function parked in await_event or areceive must wake up however many
+ *  other events are signalled, or values passed through other channels,
+ *  before it is looked at again. In particular, 256 of them must not make
+ *  the epoch look unchanged.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+AdelEvent mine, other;
+AdelChannel<int, 4> input, noise;
+int woke, received;
+
+adel waiter()
+{
+  abegin:
+  while (1) {
+    await_event( mine );
+    woke++;
+  }
+  aend;
+}
+
+adel receiver()
+{
+  int v;
+  abegin:
+  while (1) {
+    areceive( input, v );
+    received += v;
+  }
+  aend;
+}
+
+void loop()
+{
+  arepeat( waiter() );
+  arepeat( receiver() );
+}
+
+int main()
+{
+  // -- Both functions park
+  loop();
+  loop();
+  host_check(woke == 0);
+  host_check(received == 0);
+
+  for (int others = 255; others <= 257; others++) {
+    woke = 0;
+    mine.signal();
+    for (int i = 0; i < others; i++) other.signal();
+    loop();
+    host_check(woke == 1);
+    host_check( ! mine.pending());
+  }
+
+  for (int others = 255; others <= 257; others++) {
+    received = 0;
+    input.put(1);
+    int v;
+    for (int i = 0; i < others; i++) {
+      if (i % 2 == 0) noise.put(i);
+      else            noise.get(v);
+    }
+    loop();
+    host_check(received == 1);
+    while (noise.get(v)) ;
+  }
+
+  return host_failures;
+}
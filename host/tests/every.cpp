@@ -0,0 +1,78 @@
+/** aevery policies
+ *
+ *  A function that finishes right away must run once per period under
+ *  every policy, even when loop() only gets around to it a little after
+ *  each period starts. When one run takes longer than two periods, the
+ *  policy says what happens to the period it misses.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+int runs[3];
+uint16_t overruns[3];
+uint32_t lastrun[3];
+
+// -- Set to make the next run take 25 ms
+bool slow[3];
+
+adel work(int policy)
+{
+  abegin:
+  runs[policy]++;
+  lastrun[policy] = millis();
+  if (slow[policy]) {
+    slow[policy] = false;
+    adelay(25);
+  }
+  aend;
+}
+
+void loop()
+{
+  aevery_policy( 10, ADEL_CATCHUP, work(ADEL_CATCHUP) );
+  overruns[ADEL_CATCHUP] = AdelRuntime::curStack->overruns();
+  aevery_policy( 10, ADEL_SKIP, work(ADEL_SKIP) );
+  overruns[ADEL_SKIP] = AdelRuntime::curStack->overruns();
+  aevery_policy( 10, ADEL_COALESCE, work(ADEL_COALESCE) );
+  overruns[ADEL_COALESCE] = AdelRuntime::curStack->overruns();
+}
+
+int main()
+{
+  // -- 10 ms period, a pass every 3 ms
+  uint64_t end = host_clock_us + 3000000;
+  while (host_clock_us < end) {
+    loop();
+    host_advance_us(3000);
+  }
+
+  for (int p = 0; p < 3; p++) {
+    host_check(runs[p] == 300);
+    host_check(overruns[p] == 0);
+  }
+
+  // -- Now the run at 3000 ms takes until 3025 ms, so the period at
+  //    3010 passes without a run. ADEL_CATCHUP makes it up, ADEL_SKIP
+  //    drops it, and ADEL_COALESCE drops it and moves the following
+  //    periods to 3035, 3045, and so on.
+  for (int p = 0; p < 3; p++) {
+    runs[p] = 0;
+    slow[p] = true;
+  }
+  end = host_clock_us + 1000000;
+  while (host_clock_us < end) {
+    loop();
+    host_advance_us(1000);
+  }
+
+  host_check(runs[ADEL_CATCHUP] == 100);
+  host_check(runs[ADEL_SKIP] == 99);
+  host_check(runs[ADEL_COALESCE] == 99);
+  for (int p = 0; p < 3; p++)
+    host_check(overruns[p] == 1);
+  host_check(lastrun[ADEL_CATCHUP] == 3990);
+  host_check(lastrun[ADEL_SKIP] == 3990);
+  host_check(lastrun[ADEL_COALESCE] == 3995);
+
+  return host_failures;
+}
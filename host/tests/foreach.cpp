@@ -0,0 +1,55 @@
+/** aforeach counts
+ *
+ *  aforeach starts one function per element, up to count, and never more
+ *  than the array holds. Every AR it makes is gone once it is done.
+ */
+#define ADEL_MEMSTATS 1
+#include <adel.h>
+#include "hosttest.h"
+
+int pins[64];
+int started, finished;
+
+adel child(int pin)
+{
+  abegin:
+  started++;
+  adelay(pin % 5 + 1);
+  finished++;
+  aend;
+}
+
+adel all(int count)
+{
+  abegin:
+  aforeach( pins, count, child );
+  aend;
+}
+
+AdelRuntime runtime;
+
+void finish(AdelAR * f)
+{
+  AdelRuntime::curStack = & runtime;
+  runtime.init(f);
+  while ( ! runtime.run().done()) host_advance_us(1000);
+  runtime.reset();
+}
+
+int main()
+{
+  for (int i = 0; i < 64; i++) pins[i] = i;
+
+  int counts[] = { 300, 64, 10, 0, -5 };
+  int expected[] = { 64, 64, 10, 0, 0 };
+  for (int c = 0; c < 5; c++) {
+    started = finished = 0;
+    AdelRuntime::safeCall = true;
+    finish(all(counts[c]));
+    host_check(started == expected[c]);
+    host_check(finished == expected[c]);
+    host_check(AdelMemStats::total().live == 0);
+  }
+
+  return host_failures;
+}
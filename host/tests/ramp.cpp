@@ -0,0 +1,45 @@
+/** aramp and adel_now
+ *
+ *  adel_now is the time at the start of the pass, for every construct in
+ *  it. aramp reads the clock to step its value, which must not move
+ *  adel_now for the body of the ramp. Every read of the clock costs a
+ *  millisecond here, so any extra read shows up.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+uint32_t seen;
+int steps, last;
+bool finished;
+
+adel ramp()
+{
+  int v;
+  abegin:
+  seen = adel_now;
+  aramp(100, v, 0, 10) {
+    host_check(adel_now == seen);
+    steps++;
+    last = v;
+    adelay(10);
+    seen = adel_now;
+  }
+  finished = true;
+  aend;
+}
+
+void loop()
+{
+  arepeat( ramp() );
+}
+
+int main()
+{
+  host_tick_us = 1000;
+  while ( ! finished) loop();
+
+  host_check(steps >= 5);
+  host_check(last > 5 && last <= 10);
+
+  return host_failures;
+}
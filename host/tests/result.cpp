@@ -0,0 +1,116 @@
+/** areturn conversions
+ *
+ *  The value passed to areturn is converted to the type the function
+ *  returns, as a cast would, whatever type the expression has.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+enum color { RED, GREEN, BLUE };
+
+adel_of<long> twice(int x)
+{
+  abegin:
+  areturn( x * 2 );
+  aend;
+}
+
+adel_of<float> half(int x)
+{
+  abegin:
+  adelay(1);
+  areturn( x / 2.0 );
+  aend;
+}
+
+adel_of<int> truncated(double x)
+{
+  abegin:
+  areturn( x );
+  aend;
+}
+
+adel_of<uint32_t> big()
+{
+  abegin:
+  areturn( 0xFFFFFFF0u );
+  aend;
+}
+
+adel_of<int16_t> negative(uint8_t x)
+{
+  abegin:
+  areturn( -x );
+  aend;
+}
+
+adel_of<bool> odd(int x)
+{
+  abegin:
+  areturn( x % 2 );
+  aend;
+}
+
+adel_of<color> pick(int i)
+{
+  abegin:
+  if (i == 0) {
+    areturn( GREEN );
+  }
+  areturn( BLUE );
+  aend;
+}
+
+adel_of<int> nothing()
+{
+  abegin:
+  adelay(1);
+  aend;
+}
+
+long l;
+float f;
+int i, n;
+uint32_t u;
+int16_t s;
+bool b;
+color c1, c2;
+
+adel all()
+{
+  abegin:
+  andthen_get( l, twice(21) );
+  andthen_get( f, half(5) );
+  andthen_get( i, truncated(3.75) );
+  andthen_get( u, big() );
+  andthen_get( s, negative(200) );
+  andthen_get( b, odd(7) );
+  andthen_get( c1, pick(0) );
+  andthen_get( c2, pick(1) );
+  n = 99;
+  andthen_get( n, nothing() );
+  aend;
+}
+
+AdelRuntime runtime;
+
+int main()
+{
+  AdelRuntime::curStack = & runtime;
+  AdelRuntime::safeCall = true;
+  runtime.init(all());
+  while ( ! runtime.run().done()) host_advance_us(1000);
+  runtime.reset();
+
+  host_check(l == 42);
+  host_check(f == 2.5);
+  host_check(i == 3);
+  host_check(u == 0xFFFFFFF0u);
+  host_check(s == -200);
+  host_check(b);
+  host_check(c1 == GREEN);
+  host_check(c2 == BLUE);
+  host_check(n == 0);
+
+  return host_failures;
+}
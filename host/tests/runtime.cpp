@@ -0,0 +1,53 @@
+/** Runtimes that go away
+ *
+ *  A runtime on the stack deletes the function it was running when it
+ *  goes out of scope, and leaves the list of runtimes, so that adel_idle
+ *  does not look at it afterwards.
+ */
+#define ADEL_MEMSTATS 1
+#include <adel.h>
+#include "hosttest.h"
+
+adel blink()
+{
+  abegin:
+  while (1) {
+    adelay(10);
+  }
+  aend;
+}
+
+adel pair()
+{
+  abegin:
+  aboth( blink(), blink() );
+  aend;
+}
+
+uint32_t slept;
+
+void sleep(uint32_t ms)
+{
+  slept = ms;
+}
+
+int main()
+{
+  AdelRuntime::sleepfn = sleep;
+  {
+    AdelRuntime runtime;
+    AdelRuntime::curStack = &runtime;
+    AdelRuntime::safeCall = true;
+    runtime.init(pair());
+    runtime.run();
+    host_check(AdelRuntime::first == &runtime);
+    host_check(AdelMemStats::total().live == 3);
+
+    adel_idle();
+    host_check(slept == 10);
+  }
+  host_check(AdelRuntime::first == 0);
+  host_check(AdelMemStats::total().live == 0);
+
+  return host_failures;
+}
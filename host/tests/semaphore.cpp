@@ -0,0 +1,122 @@
+/** Semaphores
+ *
+ *  Functions waiting for a mutex get it in the order they asked for it,
+ *  and a function that gives up waiting leaves the line. A function that
+ *  is stopped while it holds the mutex gives it back. A release wakes
+ *  up the next function in line and nothing else: not the others in
+ *  line, and not a function parked on an event.
+ */
+#define ADEL_PROFILE 8
+#include <adel.h>
+#include "hosttest.h"
+
+AdelMutex bus;
+AdelEvent never;
+bool finished;
+
+adel user(int id)
+{
+  abegin:
+  aacquire( bus );
+  host_log("bus %d", id);
+  adelay( 10 );
+  arelease( bus );
+  aend;
+}
+
+adel patient()
+{
+  abegin:
+  aacquire( bus );
+  host_log("bus 3");
+  arelease( bus );
+  aend;
+}
+
+adel impatient()
+{
+  abegin:
+  aforatmost( 5, user(9) ) {
+    host_log("gave up");
+  }
+  aend;
+}
+
+adel holder()
+{
+  abegin:
+  aacquire( bus );
+  host_log("held");
+  adelay( 100 );
+  arelease( bus );
+  aend;
+}
+
+adel cut()
+{
+  abegin:
+  aforatmost( 10, holder() ) {
+    host_log("cut");
+  }
+  aend;
+}
+
+adel users()
+{
+  abegin:
+  athree( user(1), user(2), patient() );
+  aboth( user(4), impatient() );
+  andthen( user(5) );
+  aboth( cut(), user(6) );
+  finished = true;
+  aend;
+}
+
+adel bystander()
+{
+  abegin:
+  await_event( never );
+  aend;
+}
+
+void loop()
+{
+  arepeat( users() );
+  arepeat( bystander() );
+}
+
+int main()
+{
+  host_log_base = millis();
+  uint64_t end = host_clock_us + 1000000;
+  while ( ! finished && host_clock_us < end) {
+    loop();
+    host_advance_us(1000);
+  }
+
+  host_expect("0 bus 1\n"
+              "10 bus 2\n"
+              "20 bus 3\n"
+              "20 bus 4\n"
+              "25 gave up\n"
+              "30 bus 5\n"
+              "40 held\n"
+              "50 cut\n"
+              "50 bus 6\n");
+  host_check(bus.available() == 1);
+  host_check(bus.waiting() == 0);
+
+  // -- The third in line runs once to get in line and once when it is
+  //    its turn, not when user 1 releases
+  host_check(AdelProfile::slot("patient")->passes == 2);
+  host_check(AdelProfile::slot("bystander")->passes == 1);
+
+  // -- A semaphore that goes away leaves the list of semaphores
+  {
+    AdelSemaphore local(2);
+    host_check(AdelSemaphore::first == &local);
+  }
+  host_check(AdelSemaphore::first == &bus);
+
+  return host_failures;
+}
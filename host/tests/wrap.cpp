@@ -0,0 +1,266 @@
+/** Clock wraparound
+ *
+ *  Runs one program that uses every timed construct, starting the clock
+ *  at the value given on the command line:
+ *
+ *    zero    -- no wrap
+ *    millis  -- millis() wraps around 300 ms in
+ *    micros  -- micros() wraps around 100 ms in
+ *
+ *  The log is in milliseconds since the start, so it must come out the
+ *  same every time.
+ */
+#include <adel.h>
+#include "hosttest.h"
+
+AdelEvent ready;
+AdelChannel<int, 2> channel;
+AdelQueue<int, 2> queue;
+AdelMutex bus;
+bool flag;
+bool finished;
+int pins[3] = { 1, 2, 3 };
+
+adel blink(int n, int t)
+{
+  int i;
+  abegin:
+  for (i = 0; i < n; i++) {
+    adelay(t);
+  }
+  host_log("blink %d", t);
+  aend;
+}
+
+adel blink_us(int n, uint32_t t)
+{
+  int i;
+  abegin:
+  for (i = 0; i < n; i++) {
+    adelay_us(t);
+  }
+  host_log("blink_us %u", (unsigned) t);
+  aend;
+}
+
+adel wait_us()
+{
+  abegin:
+  aforatmost_us(2500, blink_us(1, 6000)) {
+    host_log("aforatmost_us timeout");
+  }
+  aforatmost_us(9000, blink_us(2, 1500)) {
+    host_log("never");
+  }
+  aend;
+}
+
+adel ping()
+{
+  abegin:
+  while (1) {
+    host_log("ping");
+    adelay(3);
+    ayourturn;
+  }
+  aend;
+}
+
+adel pong()
+{
+  int i;
+  abegin:
+  for (i = 0; i < 2; i++) {
+    host_log("pong");
+    adelay(4);
+    ayourturn;
+  }
+  aend;
+}
+
+adel pin(int p)
+{
+  abegin:
+  adelay(p * 10);
+  host_log("pin %d", p);
+  aend;
+}
+
+adel_of<int> measure(int t)
+{
+  abegin:
+  adelay(t);
+  areturn(t * 2);
+  aend;
+}
+
+adel producer()
+{
+  int i;
+  abegin:
+  for (i = 0; i < 3; i++) {
+    adelay(7);
+    asend(channel, i);
+    aput(queue, i * 10);
+  }
+  aend;
+}
+
+adel consumer()
+{
+  int i, v, w;
+  abegin:
+  for (i = 0; i < 3; i++) {
+    areceive(channel, v);
+    aget(queue, w);
+    host_log("got %d %d", v, w);
+  }
+  aend;
+}
+
+adel user(int id)
+{
+  abegin:
+  aacquire(bus);
+  host_log("bus %d", id);
+  adelay(15);
+  arelease(bus);
+  aend;
+}
+
+adel signaller()
+{
+  abegin:
+  adelay(40);
+  ready.signal();
+  adelay(10);
+  flag = true;
+  aend;
+}
+
+adel listener()
+{
+  abegin:
+  await_event(ready);
+  host_log("event");
+  await(flag);
+  host_log("flag");
+  aend;
+}
+
+adel program()
+{
+  int v, x;
+  abegin:
+  aboth(wait_us(), blink(1, 5));
+  andthen(blink(2, 20));
+  athree(blink(1, 10), blink(2, 10), blink(1, 30));
+  auntil(blink(1, 100), blink(5, 9)) {
+    host_log("auntil f");
+  } else {
+    host_log("auntil g");
+  }
+  aforatmost(35, blink(3, 20)) {
+    host_log("aforatmost timeout");
+  }
+  aforatmost(100, blink(1, 20)) {
+    host_log("never");
+  }
+  aall(blink(1, 15), blink(1, 25), blink(1, 5));
+  aany(blink(1, 50), blink(1, 12));
+  aforeach(pins, 3, pin);
+  alternate(ping(), pong());
+  andthen_get(x, measure(12));
+  host_log("x=%d", x);
+  aboth(producer(), consumer());
+  athree(user(1), user(2), signaller());
+  andthen(listener());
+  aramp(100, v, 0, 10) {
+    host_log("ramp %d", v);
+    adelay(25);
+  }
+  host_log("end");
+  finished = true;
+  aend;
+}
+
+adel tick()
+{
+  abegin:
+  host_log("every");
+  aend;
+}
+
+void loop()
+{
+  if (finished) return;
+  arepeat( program() );
+  aevery( 150, tick() );
+}
+
+void sleep(uint32_t ms)
+{
+  host_advance_us((uint64_t) ms * 1000);
+}
+
+int main(int argc, char ** argv)
+{
+  const char * start = argc > 1 ? argv[1] : "zero";
+  if (strcmp(start, "millis") == 0)
+    host_set_ms(0xFFFFFFFFu - 299);
+  else if (strcmp(start, "micros") == 0)
+    host_set_us(((5ull << 32) / 1000 - 100) * 1000);
+  host_log_base = millis();
+
+  AdelRuntime::sleepfn = sleep;
+  uint64_t end = host_clock_us + 5000000;
+  while ( ! finished && host_clock_us < end) {
+    loop();
+    uint64_t before = host_clock_us;
+    adel_idle();
+    if (host_clock_us == before) host_advance_us(1000);
+  }
+
+  host_expect("0 every\n"
+              "3 aforatmost_us timeout\n"
+              "5 blink 5\n"
+              "7 blink_us 1500\n"
+              "47 blink 20\n"
+              "57 blink 10\n"
+              "67 blink 10\n"
+              "77 blink 30\n"
+              "122 blink 9\n"
+              "122 auntil g\n"
+              "150 every\n"
+              "157 aforatmost timeout\n"
+              "177 blink 20\n"
+              "182 blink 5\n"
+              "192 blink 15\n"
+              "202 blink 25\n"
+              "214 blink 12\n"
+              "224 pin 1\n"
+              "234 pin 2\n"
+              "244 pin 3\n"
+              "244 ping\n"
+              "248 pong\n"
+              "253 ping\n"
+              "257 pong\n"
+              "262 ping\n"
+              "279 x=24\n"
+              "286 got 0 0\n"
+              "293 got 1 10\n"
+              "300 got 2 20\n"
+              "300 bus 1\n"
+              "300 every\n"
+              "315 bus 2\n"
+              "350 event\n"
+              "350 flag\n"
+              "350 ramp 0\n"
+              "375 ramp 2\n"
+              "400 ramp 5\n"
+              "425 ramp 7\n"
+              "450 ramp 10\n"
+              "450 every\n"
+              "475 end\n");
+  return host_failures;
+}